@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <cmath>
+#include "Audio.hpp"
+
+// requested output format; the device may pick another rate, which is then used instead
+const int AUDIO_SAMPLE_RATE = 48000;
+// loudness of the square wave, out of 32767
+const int16_t AUDIO_AMPLITUDE = 4000;
+// the buzzer of the original interpreters, used unless an XO-CHIP program loaded a pattern
+const double BEEP_FREQUENCY = 440.0;
+// XO-CHIP plays its 128-bit pattern at 4000 bits/sec at pitch 64, an octave higher every 48 steps
+const double PATTERN_BASE_RATE = 4000.0;
+const unsigned int PATTERN_BITS = 128;
+
+Audio::Audio(unsigned int deviceSamples) {
+    SDL_AudioSpec desired{};
+    desired.freq = AUDIO_SAMPLE_RATE;
+    desired.format = AUDIO_S16SYS;
+    desired.channels = 1;
+    desired.samples = static_cast<Uint16>(deviceSamples);
+    desired.callback = Callback;
+    desired.userdata = this;
+
+    SDL_AudioSpec obtained{};
+    device = SDL_OpenAudioDevice(nullptr, 0, &desired, &obtained, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+    if (device == 0) {
+        return;
+    }
+    sampleRate = obtained.freq;
+
+    // a frame is generated at once, and playback may still be draining the device buffer when it arrives
+    size_t frameSamples = static_cast<size_t>(std::ceil(static_cast<double>(sampleRate) / FRAMES_PER_SECOND));
+    maxQueued = frameSamples + obtained.samples;
+    ring.reset(new RingBuffer<int16_t>(maxQueued));
+    frame.resize(frameSamples);
+
+    SDL_PauseAudioDevice(device, 0);
+}
+
+Audio::~Audio() {
+    if (device != 0) {
+        SDL_CloseAudioDevice(device);
+    }
+}
+
+void Audio::QueueFrame(Chip8 const& chip8) {
+    if (device == 0) {
+        return;
+    }
+
+    // whole samples in this 1/60 s, carrying the fraction over so the long-run rate is exact
+    samplesDue += static_cast<double>(sampleRate) / FRAMES_PER_SECOND;
+    size_t count = std::min(static_cast<size_t>(samplesDue), frame.size());
+    samplesDue -= count;
+
+    // an XO-CHIP pattern is played bit by bit at the pitch register's rate; everything else is a plain square wave
+    uint8_t const* pattern = chip8.GetAudioPattern();
+    bool usePattern = HasInstructionSet(chip8.GetQuirks(), InstructionSet::XoChip)
+        && std::any_of(pattern, pattern + PATTERN_BITS / 8, [](uint8_t byte) { return byte != 0; });
+
+    if (chip8.GetSoundTimer() == 0) {
+        std::fill(frame.begin(), frame.begin() + count, 0);
+    } else if (usePattern) {
+        double step = PATTERN_BASE_RATE * std::pow(2.0, (chip8.GetPitch() - 64) / 48.0) / sampleRate;
+        for (size_t i = 0; i < count; ++i) {
+            unsigned int bit = static_cast<unsigned int>(phase * PATTERN_BITS) % PATTERN_BITS;
+            frame[i] = ((pattern[bit / 8] >> (7 - bit % 8)) & 1u) ? AUDIO_AMPLITUDE : -AUDIO_AMPLITUDE;
+            phase += step / PATTERN_BITS;
+            phase -= std::floor(phase);
+        }
+    } else {
+        double step = BEEP_FREQUENCY / sampleRate;
+        for (size_t i = 0; i < count; ++i) {
+            frame[i] = phase < 0.5 ? AUDIO_AMPLITUDE : -AUDIO_AMPLITUDE;
+            phase += step;
+            phase -= std::floor(phase);
+        }
+    }
+
+    // never queue more than playback needs to stay fed; the rest would only add latency
+    size_t queued = ring->GetSize();
+    size_t room = maxQueued > queued ? maxQueued - queued : 0;
+    size_t written = ring->Write(frame.data(), std::min(count, room));
+    droppedSamples += count - written;
+}
+
+void Audio::Callback(void* userdata, Uint8* stream, int length) {
+    Audio* audio = static_cast<Audio*>(userdata);
+    int16_t* samples = reinterpret_cast<int16_t*>(stream);
+    size_t count = static_cast<size_t>(length) / sizeof(int16_t);
+
+    // whatever the emulation has not produced yet is played as silence
+    size_t read = audio->ring->Read(samples, count);
+    if (read < count) {
+        std::fill(samples + read, samples + count, 0);
+        audio->underruns.fetch_add(1, std::memory_order_relaxed);
+    }
+}
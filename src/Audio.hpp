@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <SDL2/SDL.h>
+#include "Chip8.hpp"
+#include "RingBuffer.hpp"
+
+// Sound output. The emulation thread synthesises each frame's samples from the sound timer (and, for XO-CHIP, the
+// audio pattern and pitch) and queues them in a lock-free ring; the SDL audio callback only copies them out, so it
+// never locks, allocates or touches the machine. Needs SDL initialised with SDL_INIT_AUDIO.
+class Audio {
+public:
+    // deviceSamples is the size of the device's own buffer: the smaller, the lower the latency and the more often
+    // the callback runs. If no audio device can be opened the object stays silent and QueueFrame() does nothing
+    explicit Audio(unsigned int deviceSamples);
+    ~Audio();
+
+    bool IsOpen() const { return device != 0; }
+    // Synthesises and queues one 60 Hz frame of sound for chip8's current state; call from one thread only.
+    // The queue is kept to at most one frame plus the device buffer ahead of playback, anything beyond is dropped
+    void QueueFrame(Chip8 const& chip8);
+
+    // Callbacks that ran out of queued samples and had to play silence
+    unsigned long long GetUnderruns() const { return underruns.load(std::memory_order_relaxed); }
+    // Samples thrown away because enough was queued already, e.g. in turbo mode
+    unsigned long long GetDroppedSamples() const { return droppedSamples; }
+
+private:
+    static void Callback(void* userdata, Uint8* stream, int length);
+
+    SDL_AudioDeviceID device{};
+    int sampleRate{};
+    std::unique_ptr<RingBuffer<int16_t>> ring;
+    // most samples that may be queued at once
+    size_t maxQueued{};
+
+    // producer state: the frame being built, the fraction of a sample carried to the next frame and the waveform phase
+    std::vector<int16_t> frame;
+    double samplesDue{};
+    double phase{};
+    unsigned long long droppedSamples{};
+
+    std::atomic<unsigned long long> underruns{};
+};
@@ -0,0 +1,871 @@
+#include <algorithm>
+#include <cstring>
+#include "Batch.hpp"
+
+// One block of 32 lanes per instruction; without AVX2 every lane runs through ExecuteLane()
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CHIP8_BATCH_AVX2 1
+#endif
+
+static unsigned int LowestBit(uint32_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<unsigned int>(__builtin_ctz(bits));
+#else
+    unsigned int bit = 0;
+    while (!(bits & 1u)) {
+        bits >>= 1u;
+        ++bit;
+    }
+    return bit;
+#endif
+}
+
+static unsigned int CountBits(uint32_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<unsigned int>(__builtin_popcount(bits));
+#else
+    unsigned int count = 0;
+    for (; bits; bits &= bits - 1) {
+        ++count;
+    }
+    return count;
+#endif
+}
+
+#ifdef CHIP8_BATCH_AVX2
+// A lane mask spread out to one all-ones or all-zeros element per lane, for blends: 32 bytes, 16 words or 8 dwords
+static __m256i ByteMask(uint32_t bits) {
+    __m256i spread = _mm256_shuffle_epi8(_mm256_set1_epi32(static_cast<int>(bits)),
+        _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                         2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3));
+    __m256i select = _mm256_set1_epi64x(static_cast<long long>(0x8040201008040201ull));
+    return _mm256_cmpeq_epi8(_mm256_and_si256(spread, select), select);
+}
+
+static __m256i WordMask(uint32_t bits) {
+    __m256i select = _mm256_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384,
+                                       static_cast<short>(32768));
+    return _mm256_cmpeq_epi16(_mm256_and_si256(_mm256_set1_epi16(static_cast<short>(bits)), select), select);
+}
+
+static __m256i DwordMask(uint32_t bits) {
+    __m256i select = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    return _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(static_cast<int>(bits)), select), select);
+}
+
+static __m256i Load(void const* address) {
+    return _mm256_loadu_si256(static_cast<__m256i const*>(address));
+}
+
+// Stores value over the lanes in mask, keeping the rest
+static void Store(void* address, __m256i value, __m256i mask) {
+    __m256i* p = static_cast<__m256i*>(address);
+    _mm256_storeu_si256(p, _mm256_blendv_epi8(_mm256_loadu_si256(p), value, mask));
+}
+
+// A bit per lane of the 32 16-bit values at lanes that equal value. Packing the two compares to bytes interleaves
+// them by 64 bits, which the permute puts back in order
+static uint32_t Matching(uint16_t const* lanes, uint16_t value) {
+    __m256i target = _mm256_set1_epi16(static_cast<short>(value));
+    __m256i low = _mm256_cmpeq_epi16(Load(lanes), target);
+    __m256i high = _mm256_cmpeq_epi16(Load(lanes + 16), target);
+    return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_permute4x64_epi64(_mm256_packs_epi16(low, high), 0xD8)));
+}
+
+// Unsigned a > b per byte, as 0xFF or 0x00
+static __m256i GreaterThan(__m256i a, __m256i b) {
+    return _mm256_xor_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(a, b), b), _mm256_set1_epi8(-1));
+}
+#endif
+
+Batch::Batch(unsigned int lanes)
+    : laneCount(lanes), blockCount((lanes + BLOCK_LANES - 1) / BLOCK_LANES), stride(blockCount * BLOCK_LANES) {
+    registers.resize(16 * stride);
+    index.resize(stride);
+    pc.resize(stride);
+    sp.resize(stride);
+    delayTimer.resize(stride);
+    soundTimer.resize(stride);
+    rngState.resize(stride);
+    keypad.resize(stride);
+    stack.resize(16 * stride);
+    ownVideo.resize(VIDEO_HEIGHT * laneCount);
+    video = ownVideo.data();
+
+    present.resize(blockCount);
+    waiting.resize(blockCount);
+    running.resize(blockCount);
+    pending.resize(blockCount);
+    group.resize(blockCount);
+    for (unsigned int lane = 0; lane < laneCount; ++lane) {
+        present[lane / BLOCK_LANES] |= 1u << (lane % BLOCK_LANES);
+    }
+
+    image.resize(MEMORY_SIZE);
+    decoded.resize(MEMORY_SIZE);
+    pages.resize(PAGE_COUNT * stride);
+    pageSlots.resize(PAGE_COUNT * stride);
+}
+
+bool Batch::IsSupported(Quirks quirks) {
+    return !HasInstructionSet(quirks, InstructionSet::SuperChip);
+}
+
+bool Batch::IsVectorized() {
+#ifdef CHIP8_BATCH_AVX2
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool Batch::Reset(Chip8 const& machine) {
+    if (!IsSupported(machine.GetQuirks()) || machine.IsHires()) {
+        return false;
+    }
+    quirks = machine.GetQuirks();
+
+    snapshot.resize(machine.GetStateSize());
+    machine.SaveState(snapshot.data());
+
+    // the shared image is decoded once; nothing ever stores into it
+    std::copy(machine.memory, machine.memory + MEMORY_SIZE, image.begin());
+    for (unsigned int address = 0; address < MEMORY_SIZE; ++address) {
+        decoded[address] = Chip8::DecodeOpcode(
+            static_cast<uint16_t>((image[address] << 8u) | image[(address + 1) & (MEMORY_SIZE - 1)]));
+    }
+    privatePool.clear();
+    slotUsers.clear();
+    freeSlots.clear();
+    privatePages = 0;
+
+    for (unsigned int lane = 0; lane < stride; ++lane) {
+        for (unsigned int r = 0; r < 16; ++r) {
+            Register(lane, r) = machine.registers[r];
+        }
+        index[lane] = machine.index;
+        pc[lane] = machine.pc;
+        sp[lane] = machine.sp;
+        delayTimer[lane] = machine.delayTimer;
+        soundTimer[lane] = machine.soundTimer;
+        rngState[lane] = machine.rngState;
+        keypad[lane] = machine.GetKeys();
+        for (unsigned int depth = 0; depth < 16; ++depth) {
+            stack[depth * stride + lane] = machine.stack[depth];
+        }
+        for (unsigned int page = 0; page < PAGE_COUNT; ++page) {
+            pages[lane * PAGE_COUNT + page] = &image[page * PAGE_SIZE];
+            pageSlots[lane * PAGE_COUNT + page] = NO_SLOT;
+        }
+    }
+
+    for (unsigned int lane = 0; lane < laneCount; ++lane) {
+        for (unsigned int y = 0; y < VIDEO_HEIGHT; ++y) {
+            video[lane * VIDEO_HEIGHT + y] = machine.video[0][y][0];
+        }
+    }
+
+    // like a snapshot, a machine parked on Fx0A parks again when it next runs
+    std::fill(waiting.begin(), waiting.end(), 0);
+    instructions = 0;
+
+    return true;
+}
+
+void Batch::Extract(unsigned int lane, Chip8& chip8) const {
+    // everything the lanes do not hold (flags, audio, the other plane...) is as it was in the machine they came from
+    chip8.LoadState(snapshot.data(), snapshot.size());
+
+    for (unsigned int r = 0; r < 16; ++r) {
+        chip8.registers[r] = registers[r * stride + lane];
+    }
+    chip8.index = index[lane];
+    chip8.pc = pc[lane];
+    chip8.sp = sp[lane];
+    chip8.delayTimer = delayTimer[lane];
+    chip8.soundTimer = soundTimer[lane];
+    chip8.rngState = rngState[lane];
+    for (unsigned int depth = 0; depth < 16; ++depth) {
+        chip8.stack[depth] = stack[depth * stride + lane];
+    }
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; ++y) {
+        chip8.video[0][y][0] = video[lane * VIDEO_HEIGHT + y];
+    }
+    // LoadState() left the machine with memory of its own and no decodings, so the memory can be replaced underneath
+    for (unsigned int page = 0; page < PAGE_COUNT; ++page) {
+        memcpy(chip8.ownMemory.get() + page * PAGE_SIZE, pages[lane * PAGE_COUNT + page], PAGE_SIZE);
+    }
+
+    chip8.SetKeys(keypad[lane]);
+    chip8.waitingForKey = IsWaitingForKey(lane);
+}
+
+void Batch::Fork(unsigned int parent, unsigned int child) {
+    if (parent == child) {
+        return;
+    }
+
+    for (unsigned int r = 0; r < 16; ++r) {
+        Register(child, r) = Register(parent, r);
+    }
+    index[child] = index[parent];
+    pc[child] = pc[parent];
+    sp[child] = sp[parent];
+    delayTimer[child] = delayTimer[parent];
+    soundTimer[child] = soundTimer[parent];
+    rngState[child] = rngState[parent];
+    keypad[child] = keypad[parent];
+    for (unsigned int depth = 0; depth < 16; ++depth) {
+        stack[depth * stride + child] = stack[depth * stride + parent];
+    }
+    // a low-resolution screen is 256 bytes, no more than the page table, so it is simply copied
+    std::copy(GetVideo(parent), GetVideo(parent) + VIDEO_HEIGHT, &video[child * VIDEO_HEIGHT]);
+
+    for (unsigned int page = 0; page < PAGE_COUNT; ++page) {
+        uint32_t slot = pageSlots[parent * PAGE_COUNT + page];
+        if (slot != NO_SLOT) {
+            ++slotUsers[slot];
+        }
+        Release(pageSlots[child * PAGE_COUNT + page]);
+        pageSlots[child * PAGE_COUNT + page] = slot;
+        pages[child * PAGE_COUNT + page] = pages[parent * PAGE_COUNT + page];
+    }
+
+    uint32_t bit = 1u << (child % BLOCK_LANES);
+    waiting[child / BLOCK_LANES] = IsWaitingForKey(parent) ? waiting[child / BLOCK_LANES] | bit
+                                                           : waiting[child / BLOCK_LANES] & ~bit;
+}
+
+void Batch::SetVideo(uint64_t* rows) {
+    uint64_t* target = rows ? rows : ownVideo.data();
+    if (target != video) {
+        std::copy(video, video + VIDEO_HEIGHT * laneCount, target);
+        video = target;
+    }
+}
+
+void Batch::SetSeed(unsigned int lane, unsigned int seed) {
+    rngState[lane] = seed != 0 ? seed : 0x9E3779B9u;
+}
+
+void Batch::Write(unsigned int lane, unsigned int address, uint8_t value) {
+    address &= MEMORY_SIZE - 1;
+    unsigned int page = address / PAGE_SIZE;
+    uint8_t*& target = pages[lane * PAGE_COUNT + page];
+    uint32_t& slot = pageSlots[lane * PAGE_COUNT + page];
+
+    if (slot == NO_SLOT || slotUsers[slot] > 1) {
+        // storing what is already there changes nothing, so the page can stay shared
+        if (target[address % PAGE_SIZE] == value) {
+            return;
+        }
+        uint32_t copy;
+        if (!freeSlots.empty()) {
+            copy = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            copy = static_cast<uint32_t>(privatePool.size());
+            privatePool.emplace_back();
+            slotUsers.push_back(0);
+        }
+        std::copy(target, target + PAGE_SIZE, privatePool[copy].begin());
+        slotUsers[copy] = 1;
+        Release(slot);
+        slot = copy;
+        target = privatePool[copy].data();
+        privatePages |= 1u << page;
+    }
+
+    target[address % PAGE_SIZE] = value;
+}
+
+void Batch::Release(uint32_t slot) {
+    if (slot != NO_SLOT && --slotUsers[slot] == 0) {
+        freeSlots.push_back(slot);
+    }
+}
+
+void Batch::Run(unsigned int cycles) {
+    // a lane parked on Fx0A sits the call out unless a key is now down, as Chip8::Run returns at once
+    for (unsigned int block = 0; block < blockCount; ++block) {
+        uint32_t idle = 0;
+        for (uint32_t bits = waiting[block]; bits; bits &= bits - 1) {
+            unsigned int lane = block * BLOCK_LANES + LowestBit(bits);
+            idle |= (keypad[lane] == 0) << (lane % BLOCK_LANES);
+        }
+        running[block] = present[block] & ~idle;
+    }
+
+    switch (quirks) {
+        case Quirks::Vip: RunWith<Quirks::Vip>(cycles); break;
+        case Quirks::Chip48: RunWith<Quirks::Chip48>(cycles); break;
+        default: RunWith<Quirks::Modern>(cycles); break;
+    }
+}
+
+void Batch::TickTimers() {
+#ifdef CHIP8_BATCH_AVX2
+    // saturating, so timers already at zero stay there
+    __m256i one = _mm256_set1_epi8(1);
+    for (unsigned int lane = 0; lane < stride; lane += BLOCK_LANES) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(&delayTimer[lane]), _mm256_subs_epu8(Load(&delayTimer[lane]), one));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(&soundTimer[lane]), _mm256_subs_epu8(Load(&soundTimer[lane]), one));
+    }
+#else
+    for (unsigned int lane = 0; lane < stride; ++lane) {
+        delayTimer[lane] -= delayTimer[lane] > 0;
+        soundTimer[lane] -= soundTimer[lane] > 0;
+    }
+#endif
+}
+
+void Batch::RunFrame(unsigned int cyclesPerFrame) {
+    Run(cyclesPerFrame);
+    TickTimers();
+}
+
+template <Quirks Q>
+void Batch::RunWith(unsigned int cycles) {
+    for (; cycles > 0; --cycles) {
+        if (std::none_of(running.begin(), running.end(), [](uint32_t bits) { return bits != 0; })) {
+            return;
+        }
+        Step<Q>();
+    }
+}
+
+template <Quirks Q>
+void Batch::Step() {
+    std::copy(running.begin(), running.end(), pending.begin());
+    for (uint32_t bits : running) {
+        instructions += CountBits(bits);
+    }
+
+    // take the first lane that has not run yet, and with it every other lane at the same pc
+    for (unsigned int block = 0; block < blockCount; ++block) {
+        while (pending[block]) {
+            unsigned int lead = block * BLOCK_LANES + LowestBit(pending[block]);
+            uint16_t address = pc[lead];
+            Group(block, address);
+
+            unsigned int code = address & (MEMORY_SIZE - 1);
+            unsigned int next = (code + 1) & (MEMORY_SIZE - 1);
+            if (!((privatePages >> (code / PAGE_SIZE)) & 1u) && !((privatePages >> (next / PAGE_SIZE)) & 1u)) {
+                Execute<Q>(block, decoded[code], address);
+            } else {
+                // some lane has rewritten a page the opcode is on: only lanes that read the same opcode go together
+                uint16_t opcode = static_cast<uint16_t>((Read(lead, code) << 8u) | Read(lead, next));
+                for (unsigned int b = block; b < blockCount; ++b) {
+                    for (uint32_t bits = group[b]; bits; bits &= bits - 1) {
+                        unsigned int lane = b * BLOCK_LANES + LowestBit(bits);
+                        if (((Read(lane, code) << 8u) | Read(lane, next)) != opcode) {
+                            group[b] &= ~(1u << (lane % BLOCK_LANES));
+                        }
+                    }
+                }
+                Execute<Q>(block, Chip8::DecodeOpcode(opcode), address);
+            }
+
+            for (unsigned int b = block; b < blockCount; ++b) {
+                pending[b] &= ~group[b];
+            }
+        }
+    }
+}
+
+void Batch::Group(unsigned int first, uint16_t address) {
+#ifdef CHIP8_BATCH_AVX2
+    for (unsigned int block = first; block < blockCount; ++block) {
+        group[block] = pending[block] ? pending[block] & Matching(&pc[block * BLOCK_LANES], address) : 0;
+    }
+#else
+    for (unsigned int block = first; block < blockCount; ++block) {
+        uint32_t bits = 0;
+        for (uint32_t candidates = pending[block]; candidates; candidates &= candidates - 1) {
+            unsigned int lane = LowestBit(candidates);
+            bits |= (pc[block * BLOCK_LANES + lane] == address) << lane;
+        }
+        group[block] = bits;
+    }
+#endif
+}
+
+template <Quirks Q>
+void Batch::Execute(unsigned int first, Chip8::Instruction const& instruction, uint16_t address) {
+#ifdef CHIP8_BATCH_AVX2
+    if (ExecuteVector<Q>(first, instruction, address)) {
+        return;
+    }
+#endif
+
+    for (unsigned int block = first; block < blockCount; ++block) {
+        ExecuteLanes<Q>(block, group[block], instruction, address);
+    }
+}
+
+template <Quirks Q>
+void Batch::ExecuteLanes(unsigned int block, uint32_t bits, Chip8::Instruction const& instruction, uint16_t address) {
+    for (; bits; bits &= bits - 1) {
+        unsigned int lane = block * BLOCK_LANES + LowestBit(bits);
+        pc[lane] = static_cast<uint16_t>(address + 2);
+        ExecuteLane<Q>(lane, instruction);
+    }
+}
+
+template <Quirks Q>
+bool Batch::ExecuteVector(unsigned int first, Chip8::Instruction const& instruction, uint16_t address) {
+#ifdef CHIP8_BATCH_AVX2
+    using Op = Chip8::Op;
+    constexpr QuirkFlags flags = QUIRK_FLAGS[static_cast<size_t>(Q)];
+
+    // drawing, Bnnn, Fx0A and the stores always go one lane at a time; calls, returns and Fx65 only when the lanes of
+    // a block disagree on sp or I, or the memory read is on a page a lane has copied
+    switch (instruction.op) {
+        case Op::OP_NULL: case Op::OP_00EE: case Op::OP_1nnn: case Op::OP_2nnn: case Op::OP_3xkk: case Op::OP_4xkk:
+        case Op::OP_5xy0: case Op::OP_5xy2: case Op::OP_5xy3: case Op::OP_6xkk: case Op::OP_7xkk: case Op::OP_8xy0:
+        case Op::OP_8xy1: case Op::OP_8xy2: case Op::OP_8xy3: case Op::OP_8xy4: case Op::OP_8xy5: case Op::OP_8xy6:
+        case Op::OP_8xy7: case Op::OP_8xyE: case Op::OP_9xy0: case Op::OP_Annn: case Op::OP_Cxkk: case Op::OP_Ex9E:
+        case Op::OP_ExA1: case Op::OP_Fx07: case Op::OP_Fx15: case Op::OP_Fx18: case Op::OP_Fx1E: case Op::OP_Fx29:
+        case Op::OP_Fx65:
+            break;
+        default:
+            return false;
+    }
+
+    uint8_t x = instruction.x;
+    uint8_t y = instruction.y;
+    __m256i zero = _mm256_setzero_si256();
+    __m256i one = _mm256_set1_epi8(1);
+    __m256i next = _mm256_set1_epi16(static_cast<short>(address + 2));
+    __m256i skipped = _mm256_set1_epi16(static_cast<short>(address + 4));
+
+    for (unsigned int block = first; block < blockCount; ++block) {
+        uint32_t bits = group[block];
+        if (!bits) {
+            continue;
+        }
+
+        unsigned int base = block * BLOCK_LANES;
+        __m256i mask = ByteMask(bits);
+        uint8_t* vx = &registers[x * stride + base];
+        uint8_t* vy = &registers[y * stride + base];
+        uint8_t* vf = &registers[0xF * stride + base];
+        // lanes whose skip is taken, and where the others go, 16 lanes a half
+        uint32_t skips = 0;
+        __m256i target[2] = {next, next};
+        if (instruction.op == Op::OP_1nnn) {
+            target[0] = target[1] = _mm256_set1_epi16(static_cast<short>(instruction.nnn));
+        }
+
+        // each case follows its Chip8 handler statement by statement, reloading after every store, so that
+        // instructions naming VF see the same values
+        switch (instruction.op) {
+            case Op::OP_3xkk:
+                skips = bits & static_cast<uint32_t>(_mm256_movemask_epi8(
+                    _mm256_cmpeq_epi8(Load(vx), _mm256_set1_epi8(static_cast<char>(instruction.kk)))));
+                break;
+            case Op::OP_4xkk:
+                skips = bits & ~static_cast<uint32_t>(_mm256_movemask_epi8(
+                    _mm256_cmpeq_epi8(Load(vx), _mm256_set1_epi8(static_cast<char>(instruction.kk)))));
+                break;
+            // 5xy2/5xy3 are XO-CHIP; the supported profiles run them as 5xy0
+            case Op::OP_5xy0: case Op::OP_5xy2: case Op::OP_5xy3:
+                skips = bits & static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(Load(vx), Load(vy))));
+                break;
+            case Op::OP_9xy0:
+                skips = bits & ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(Load(vx), Load(vy))));
+                break;
+            case Op::OP_Ex9E:
+            case Op::OP_ExA1: {
+                // the bit for key Vx, split into the keypad's low and high byte by two table lookups
+                __m256i key = _mm256_and_si256(Load(vx), _mm256_set1_epi8(0x0F));
+                __m256i lowBit = _mm256_shuffle_epi8(_mm256_setr_epi8(
+                    1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0,
+                    1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0), key);
+                __m256i highBit = _mm256_shuffle_epi8(_mm256_setr_epi8(
+                    0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 4, 8, 16, 32, 64, -128,
+                    0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 4, 8, 16, 32, 64, -128), key);
+                __m256i a = Load(&keypad[base]);
+                __m256i b = Load(&keypad[base + 16]);
+                __m256i byteMask = _mm256_set1_epi16(0xFF);
+                __m256i lowKeys = _mm256_permute4x64_epi64(
+                    _mm256_packus_epi16(_mm256_and_si256(a, byteMask), _mm256_and_si256(b, byteMask)), 0xD8);
+                __m256i highKeys = _mm256_permute4x64_epi64(
+                    _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8)), 0xD8);
+                __m256i held = _mm256_or_si256(_mm256_and_si256(lowKeys, lowBit), _mm256_and_si256(highKeys, highBit));
+                uint32_t up = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(held, zero)));
+                skips = bits & (instruction.op == Op::OP_Ex9E ? ~up : up);
+                break;
+            }
+            case Op::OP_2nnn:
+            case Op::OP_00EE: {
+                // together only if every lane is at the same depth
+                uint8_t depth = sp[base + LowestBit(bits)];
+                uint32_t same = static_cast<uint32_t>(_mm256_movemask_epi8(
+                    _mm256_cmpeq_epi8(Load(&sp[base]), _mm256_set1_epi8(static_cast<char>(depth)))));
+                if ((bits & same) != bits) {
+                    ExecuteLanes<Q>(block, bits, instruction, address);
+                    continue;
+                }
+                if (instruction.op == Op::OP_2nnn) {
+                    for (unsigned int half = 0; half < 2; ++half) {
+                        Store(&stack[depth * stride + base + half * 16], next, WordMask((bits >> (half * 16)) & 0xFFFFu));
+                    }
+                    depth = (depth + 1) & 0xFu;
+                    target[0] = target[1] = _mm256_set1_epi16(static_cast<short>(instruction.nnn));
+                } else {
+                    depth = (depth - 1) & 0xFu;
+                    target[0] = Load(&stack[depth * stride + base]);
+                    target[1] = Load(&stack[depth * stride + base + 16]);
+                }
+                Store(&sp[base], _mm256_set1_epi8(static_cast<char>(depth)), mask);
+                break;
+            }
+            case Op::OP_Fx65: {
+                // together only if every lane reads the same bytes: the same I, on pages none of them has copied
+                uint16_t start = index[base + LowestBit(bits)];
+                bool shared = (bits & Matching(&index[base], start)) == bits;
+                for (unsigned int i = 0; i <= x && shared; ++i) {
+                    shared = !((privatePages >> (((start + i) & (MEMORY_SIZE - 1)) / PAGE_SIZE)) & 1u);
+                }
+                if (!shared) {
+                    ExecuteLanes<Q>(block, bits, instruction, address);
+                    continue;
+                }
+                for (unsigned int i = 0; i <= x; ++i) {
+                    Store(&registers[i * stride + base],
+                          _mm256_set1_epi8(static_cast<char>(image[(start + i) & (MEMORY_SIZE - 1)])), mask);
+                }
+                if constexpr (flags.loadStoreIncrement != IndexIncrement::None) {
+                    uint16_t end = static_cast<uint16_t>(start + x + (flags.loadStoreIncrement == IndexIncrement::XPlusOne));
+                    for (unsigned int half = 0; half < 2; ++half) {
+                        Store(&index[base + half * 16], _mm256_set1_epi16(static_cast<short>(end)),
+                              WordMask((bits >> (half * 16)) & 0xFFFFu));
+                    }
+                }
+                break;
+            }
+            case Op::OP_6xkk:
+                Store(vx, _mm256_set1_epi8(static_cast<char>(instruction.kk)), mask);
+                break;
+            case Op::OP_7xkk:
+                Store(vx, _mm256_add_epi8(Load(vx), _mm256_set1_epi8(static_cast<char>(instruction.kk))), mask);
+                break;
+            case Op::OP_8xy0:
+                Store(vx, Load(vy), mask);
+                break;
+            case Op::OP_8xy1:
+            case Op::OP_8xy2:
+            case Op::OP_8xy3: {
+                __m256i a = Load(vx);
+                __m256i b = Load(vy);
+                __m256i result = instruction.op == Op::OP_8xy1 ? _mm256_or_si256(a, b)
+                    : instruction.op == Op::OP_8xy2 ? _mm256_and_si256(a, b) : _mm256_xor_si256(a, b);
+                Store(vx, result, mask);
+                if constexpr (flags.logicResetsVF) {
+                    Store(vf, zero, mask);
+                }
+                break;
+            }
+            case Op::OP_8xy4: {
+                __m256i sum = _mm256_add_epi8(Load(vx), Load(vy));
+                // the sum wrapped if it came out below either operand
+                __m256i carry = GreaterThan(Load(vx), sum);
+                Store(vf, _mm256_and_si256(carry, one), mask);
+                Store(vx, sum, mask);
+                break;
+            }
+            case Op::OP_8xy5:
+                Store(vf, _mm256_and_si256(GreaterThan(Load(vx), Load(vy)), one), mask);
+                Store(vx, _mm256_sub_epi8(Load(vx), Load(vy)), mask);
+                break;
+            case Op::OP_8xy7:
+                Store(vf, _mm256_and_si256(GreaterThan(Load(vy), Load(vx)), one), mask);
+                Store(vx, _mm256_sub_epi8(Load(vy), Load(vx)), mask);
+                break;
+            case Op::OP_8xy6:
+                // bytes are shifted as words, then the bit that crossed in from the neighbouring byte is cleared
+                if constexpr (flags.shiftUsesVy) {
+                    __m256i source = Load(vy);
+                    Store(vx, _mm256_and_si256(_mm256_srli_epi16(source, 1), _mm256_set1_epi8(0x7F)), mask);
+                    Store(vf, _mm256_and_si256(source, one), mask);
+                } else {
+                    Store(vf, _mm256_and_si256(Load(vx), one), mask);
+                    Store(vx, _mm256_and_si256(_mm256_srli_epi16(Load(vx), 1), _mm256_set1_epi8(0x7F)), mask);
+                }
+                break;
+            case Op::OP_8xyE:
+                if constexpr (flags.shiftUsesVy) {
+                    __m256i source = Load(vy);
+                    Store(vx, _mm256_add_epi8(source, source), mask);
+                    Store(vf, _mm256_and_si256(_mm256_srli_epi16(source, 7), one), mask);
+                } else {
+                    Store(vf, _mm256_and_si256(_mm256_srli_epi16(Load(vx), 7), one), mask);
+                    Store(vx, _mm256_add_epi8(Load(vx), Load(vx)), mask);
+                }
+                break;
+            case Op::OP_Cxkk: {
+                // xorshift32 on 8 lanes at a time, then the top bytes packed back into lane order
+                __m256i bytes[4];
+                for (unsigned int quarter = 0; quarter < 4; ++quarter) {
+                    uint32_t* lanes = &rngState[base + quarter * 8];
+                    __m256i state = Load(lanes);
+                    state = _mm256_xor_si256(state, _mm256_slli_epi32(state, 13));
+                    state = _mm256_xor_si256(state, _mm256_srli_epi32(state, 17));
+                    state = _mm256_xor_si256(state, _mm256_slli_epi32(state, 5));
+                    Store(lanes, state, DwordMask((bits >> (quarter * 8)) & 0xFFu));
+                    bytes[quarter] = _mm256_srli_epi32(Load(lanes), 24);
+                }
+                __m256i packed = _mm256_packus_epi16(_mm256_packus_epi32(bytes[0], bytes[1]),
+                                                     _mm256_packus_epi32(bytes[2], bytes[3]));
+                packed = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+                Store(vx, _mm256_and_si256(packed, _mm256_set1_epi8(static_cast<char>(instruction.kk))), mask);
+                break;
+            }
+            case Op::OP_Fx07:
+                Store(vx, Load(&delayTimer[base]), mask);
+                break;
+            case Op::OP_Fx15:
+                Store(&delayTimer[base], Load(vx), mask);
+                break;
+            case Op::OP_Fx18:
+                Store(&soundTimer[base], Load(vx), mask);
+                break;
+            case Op::OP_Annn:
+            case Op::OP_Fx1E:
+            case Op::OP_Fx29:
+                // I is 16 bits, so each half of the block is widened and done on its own
+                for (unsigned int half = 0; half < 2; ++half) {
+                    uint16_t* lanes = &index[base + half * 16];
+                    __m256i value = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<__m128i const*>(vx + half * 16)));
+                    __m256i result = instruction.op == Op::OP_Annn ? _mm256_set1_epi16(static_cast<short>(instruction.nnn))
+                        : instruction.op == Op::OP_Fx1E ? _mm256_add_epi16(Load(lanes), value)
+                        : _mm256_add_epi16(_mm256_mullo_epi16(value, _mm256_set1_epi16(5)),
+                                           _mm256_set1_epi16(static_cast<short>(FONTSET_START_ADDRESS)));
+                    Store(lanes, result, WordMask((bits >> (half * 16)) & 0xFFFFu));
+                }
+                break;
+            default:
+                break;
+        }
+
+        // then the pc of every lane in the group: the jump target, the next instruction or the one after it
+        for (unsigned int half = 0; half < 2; ++half) {
+            uint16_t* lanes = &pc[base + half * 16];
+            Store(lanes, target[half], WordMask((bits >> (half * 16)) & 0xFFFFu));
+            if (skips) {
+                Store(lanes, skipped, WordMask((skips >> (half * 16)) & 0xFFFFu));
+            }
+        }
+    }
+
+    return true;
+#else
+    (void)first;
+    (void)instruction;
+    (void)address;
+    return false;
+#endif
+}
+
+template <Quirks Q>
+void Batch::ExecuteLane(unsigned int lane, Chip8::Instruction const& instruction) {
+    using Op = Chip8::Op;
+    constexpr QuirkFlags flags = QUIRK_FLAGS[static_cast<size_t>(Q)];
+
+    uint8_t x = instruction.x;
+    uint8_t y = instruction.y;
+    uint8_t& Vx = Register(lane, x);
+    uint8_t& Vy = Register(lane, y);
+    uint8_t& VF = Register(lane, 0xF);
+    uint64_t* screen = &video[lane * VIDEO_HEIGHT];
+
+    // the same steps as the Chip8 handler of each opcode, on this lane's slice of the arrays
+    switch (instruction.op) {
+        case Op::OP_00E0:
+            std::fill(screen, screen + VIDEO_HEIGHT, 0);
+            break;
+        case Op::OP_00EE:
+            sp[lane] = (sp[lane] - 1) & 0xFu;
+            pc[lane] = stack[sp[lane] * stride + lane];
+            break;
+        case Op::OP_1nnn:
+            pc[lane] = instruction.nnn;
+            break;
+        case Op::OP_2nnn:
+            stack[sp[lane] * stride + lane] = pc[lane];
+            sp[lane] = (sp[lane] + 1) & 0xFu;
+            pc[lane] = instruction.nnn;
+            break;
+        case Op::OP_3xkk:
+            pc[lane] += (Vx == instruction.kk) * 2;
+            break;
+        case Op::OP_4xkk:
+            pc[lane] += (Vx != instruction.kk) * 2;
+            break;
+        case Op::OP_5xy0: case Op::OP_5xy2: case Op::OP_5xy3:
+            pc[lane] += (Vx == Vy) * 2;
+            break;
+        case Op::OP_9xy0:
+            pc[lane] += (Vx != Vy) * 2;
+            break;
+        case Op::OP_6xkk:
+            Vx = instruction.kk;
+            break;
+        case Op::OP_7xkk:
+            Vx += instruction.kk;
+            break;
+        case Op::OP_8xy0:
+            Vx = Vy;
+            break;
+        case Op::OP_8xy1:
+            Vx |= Vy;
+            if constexpr (flags.logicResetsVF) {
+                VF = 0;
+            }
+            break;
+        case Op::OP_8xy2:
+            Vx &= Vy;
+            if constexpr (flags.logicResetsVF) {
+                VF = 0;
+            }
+            break;
+        case Op::OP_8xy3:
+            Vx ^= Vy;
+            if constexpr (flags.logicResetsVF) {
+                VF = 0;
+            }
+            break;
+        case Op::OP_8xy4: {
+            unsigned int sum = Vx + Vy;
+            VF = sum > 255u;
+            Vx = sum & 0xFFu;
+            break;
+        }
+        case Op::OP_8xy5:
+            VF = Vx > Vy;
+            Vx -= Vy;
+            break;
+        case Op::OP_8xy6:
+            if constexpr (flags.shiftUsesVy) {
+                uint8_t source = Vy;
+                Vx = source >> 1;
+                VF = source & 0x1u;
+            } else {
+                VF = Vx & 0x1u;
+                Vx >>= 1;
+            }
+            break;
+        case Op::OP_8xy7:
+            VF = Vy > Vx;
+            Vx = Vy - Vx;
+            break;
+        case Op::OP_8xyE:
+            if constexpr (flags.shiftUsesVy) {
+                uint8_t source = Vy;
+                Vx = source << 1;
+                VF = (source & 0x80u) >> 7u;
+            } else {
+                VF = (Vx & 0x80u) >> 7u;
+                Vx <<= 1;
+            }
+            break;
+        case Op::OP_Annn:
+            index[lane] = instruction.nnn;
+            break;
+        case Op::OP_Bnnn:
+            if constexpr (flags.jumpUsesVx) {
+                pc[lane] = Vx + instruction.nnn;
+            } else {
+                pc[lane] = Register(lane, 0) + instruction.nnn;
+            }
+            break;
+        case Op::OP_Cxkk: {
+            uint32_t& state = rngState[lane];
+            state ^= state << 13u;
+            state ^= state >> 17u;
+            state ^= state << 5u;
+            Vx = (state >> 24u) & instruction.kk;
+            break;
+        }
+        case Op::OP_Dxyn: {
+            // low resolution and clipped: every supported profile draws this way
+            unsigned int xPos = Vx % VIDEO_WIDTH;
+            unsigned int yPos = Vy % VIDEO_HEIGHT;
+            uint64_t collision = 0;
+            for (unsigned int row = 0; row < instruction.n && yPos + row < VIDEO_HEIGHT; ++row) {
+                uint64_t sprite = static_cast<uint64_t>(Read(lane, index[lane] + row)) << 56u >> xPos;
+                collision |= screen[yPos + row] & sprite;
+                screen[yPos + row] ^= sprite;
+            }
+            VF = collision != 0;
+            break;
+        }
+        case Op::OP_Ex9E:
+            pc[lane] += ((keypad[lane] >> (Vx & 0xFu)) & 1u) * 2;
+            break;
+        case Op::OP_ExA1:
+            pc[lane] += !((keypad[lane] >> (Vx & 0xFu)) & 1u) * 2;
+            break;
+        case Op::OP_Fx07:
+            Vx = delayTimer[lane];
+            break;
+        case Op::OP_Fx0A: {
+            uint32_t bit = 1u << (lane % BLOCK_LANES);
+            uint16_t keys = keypad[lane];
+            if (keys == 0) {
+                // parked: this lane is done for the call, as Chip8::Run returns
+                pc[lane] -= 2;
+                waiting[lane / BLOCK_LANES] |= bit;
+                running[lane / BLOCK_LANES] &= ~bit;
+                break;
+            }
+            Vx = static_cast<uint8_t>(LowestBit(keys));
+            waiting[lane / BLOCK_LANES] &= ~bit;
+            break;
+        }
+        case Op::OP_Fx15:
+            delayTimer[lane] = Vx;
+            break;
+        case Op::OP_Fx18:
+            soundTimer[lane] = Vx;
+            break;
+        case Op::OP_Fx1E:
+            index[lane] += Vx;
+            break;
+        case Op::OP_Fx29:
+            index[lane] = FONTSET_START_ADDRESS + 5 * Vx;
+            break;
+        case Op::OP_Fx33: {
+            uint8_t value = Vx;
+            Write(lane, index[lane], value / 100 % 10);
+            Write(lane, index[lane] + 1u, value / 10 % 10);
+            Write(lane, index[lane] + 2u, value % 10);
+            break;
+        }
+        case Op::OP_Fx55:
+            for (unsigned int i = 0; i <= x; ++i) {
+                Write(lane, index[lane] + i, Register(lane, i));
+            }
+            if constexpr (flags.loadStoreIncrement == IndexIncrement::X) {
+                index[lane] += x;
+            } else if constexpr (flags.loadStoreIncrement == IndexIncrement::XPlusOne) {
+                index[lane] += x + 1;
+            }
+            break;
+        case Op::OP_Fx65:
+            for (unsigned int i = 0; i <= x; ++i) {
+                Register(lane, i) = Read(lane, index[lane] + i);
+            }
+            if constexpr (flags.loadStoreIncrement == IndexIncrement::X) {
+                index[lane] += x;
+            } else if constexpr (flags.loadStoreIncrement == IndexIncrement::XPlusOne) {
+                index[lane] += x + 1;
+            }
+            break;
+        // the SUPER-CHIP and XO-CHIP opcodes do nothing under the supported profiles
+        default:
+            break;
+    }
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include "Chip8.hpp"
+
+// Runs many copies of one machine in lockstep, for searches and training runs that differ only in input and RNG.
+// Each piece of state is kept as one array across lanes (V3 of every lane is contiguous), so lanes at the same pc
+// run an instruction together, 32 at a time with AVX2. Lanes that diverge are regrouped by pc on every step.
+// Memory starts out shared: a lane gets its own copy of a 256-byte page the first time it changes a byte in it.
+// Only the original instruction set in low resolution is supported (the vip, chip48 and modern profiles).
+class Batch {
+public:
+    // Lanes are grouped in blocks of this many, the width of one AVX2 register of bytes
+    static constexpr unsigned int BLOCK_LANES = 32;
+    static constexpr unsigned int PAGE_SIZE = 256;
+    static constexpr unsigned int PAGE_COUNT = MEMORY_SIZE / PAGE_SIZE;
+
+    explicit Batch(unsigned int lanes);
+
+    Batch(Batch const&) = delete;
+    Batch& operator=(Batch const&) = delete;
+
+    // True if machines with this profile can be batched
+    static bool IsSupported(Quirks quirks);
+    // True when this build runs the vector code; otherwise every lane is stepped on its own
+    static bool IsVectorized();
+
+    // Makes every lane a copy of machine (a loaded ROM, typically), including its RNG state and keys. Returns false
+    // and leaves the lanes untouched if its profile is not supported or it is in high resolution
+    bool Reset(Chip8 const& machine);
+    // Copies lane back out into a full machine, e.g. to check it or to carry on with it on its own
+    void Extract(unsigned int lane, Chip8& chip8) const;
+    // Makes child a copy of parent, keys included, to branch a search from parent's state. Memory pages are shared
+    // rather than copied, until one of the two stores into them. Only between runs
+    void Fork(unsigned int parent, unsigned int child);
+
+    // Runs cycles instructions on every lane, as Chip8::Run would; a lane parked on Fx0A stops early
+    void Run(unsigned int cycles);
+    void TickTimers();
+    void RunFrame(unsigned int cyclesPerFrame);
+
+    unsigned int GetLaneCount() const { return laneCount; }
+    // Reseeds one lane's RNG the way the Chip8 constructor does
+    void SetSeed(unsigned int lane, unsigned int seed);
+    // Keypad of one lane, bit n = key n
+    void SetKeys(unsigned int lane, uint16_t keys) { keypad[lane] = keys; }
+    uint16_t GetKeys(unsigned int lane) const { return keypad[lane]; }
+    bool IsWaitingForKey(unsigned int lane) const { return (waiting[lane / BLOCK_LANES] >> (lane % BLOCK_LANES)) & 1u; }
+    uint16_t GetPC(unsigned int lane) const { return pc[lane]; }
+    // VIDEO_HEIGHT rows of one lane's screen, most significant bit is the leftmost pixel
+    uint64_t const* GetVideo(unsigned int lane) const { return &video[lane * VIDEO_HEIGHT]; }
+    // Draws into rows from now on, VIDEO_HEIGHT per lane for every lane, e.g. a buffer another process reads; the
+    // screens so far are copied there first. Null goes back to the batch's own storage
+    void SetVideo(uint64_t* rows);
+
+    // Instructions run over all lanes since Reset()
+    unsigned long long GetInstructions() const { return instructions; }
+    // Page copies some lane is using
+    size_t GetPrivatePages() const { return privatePool.size() - freeSlots.size(); }
+
+private:
+    template <Quirks Q>
+    void RunWith(unsigned int cycles);
+    // Runs one instruction on every running lane
+    template <Quirks Q>
+    void Step();
+    // Limits group to the pending lanes from block first on whose pc is address
+    void Group(unsigned int first, uint16_t address);
+    // Runs instruction at address on the lanes in group, the vector way if there is one
+    template <Quirks Q>
+    void Execute(unsigned int first, Chip8::Instruction const& instruction, uint16_t address);
+    template <Quirks Q>
+    bool ExecuteVector(unsigned int first, Chip8::Instruction const& instruction, uint16_t address);
+    // Runs instruction on the lanes in bits of one block, one after the other
+    template <Quirks Q>
+    void ExecuteLanes(unsigned int block, uint32_t bits, Chip8::Instruction const& instruction, uint16_t address);
+    // The reference for every instruction, on one lane whose pc has already been advanced
+    template <Quirks Q>
+    void ExecuteLane(unsigned int lane, Chip8::Instruction const& instruction);
+
+    uint8_t& Register(unsigned int lane, unsigned int r) { return registers[r * stride + lane]; }
+    uint8_t Read(unsigned int lane, unsigned int address) const {
+        address &= MEMORY_SIZE - 1;
+        return pages[lane * PAGE_COUNT + address / PAGE_SIZE][address % PAGE_SIZE];
+    }
+    // Stores value, first copying the page if the lane still shares it and the value is not already there
+    void Write(unsigned int lane, unsigned int address, uint8_t value);
+    // Drops one lane's use of a page copy, freeing it after the last one
+    void Release(uint32_t slot);
+
+    unsigned int laneCount{};
+    unsigned int blockCount{};
+    // lanes allocated per array, a whole number of blocks; the lanes past laneCount never run
+    unsigned int stride{};
+    Quirks quirks = Quirks::Modern;
+
+    // V0-VF: register r of lane l at [r * stride + l]
+    std::vector<uint8_t> registers;
+    std::vector<uint16_t> index;
+    std::vector<uint16_t> pc;
+    std::vector<uint8_t> sp;
+    std::vector<uint8_t> delayTimer;
+    std::vector<uint8_t> soundTimer;
+    std::vector<uint32_t> rngState;
+    std::vector<uint16_t> keypad;
+    // entry d of lane l at [d * stride + l], so a block whose lanes agree on sp calls and returns together
+    std::vector<uint16_t> stack;
+    // only drawn one lane at a time, so kept per lane: VIDEO_HEIGHT rows each, in ownVideo or the caller's memory
+    std::vector<uint64_t> ownVideo;
+    uint64_t* video{};
+
+    // a bit per lane, one word per block: lanes that exist, lanes parked on Fx0A, lanes still running this call
+    std::vector<uint32_t> present;
+    std::vector<uint32_t> waiting;
+    std::vector<uint32_t> running;
+    // per step: lanes that have not run yet, and the lanes running the current instruction
+    std::vector<uint32_t> pending;
+    std::vector<uint32_t> group;
+
+    // memory every lane starts from, never written, and its decoding
+    std::vector<uint8_t> image;
+    std::vector<Chip8::Instruction> decoded;
+    // PAGE_COUNT pages per lane, each pointing into image or at a copy in privatePool
+    std::vector<uint8_t*> pages;
+    // the privatePool slot each of those pages is in, NO_SLOT for the image
+    static constexpr uint32_t NO_SLOT = ~0u;
+    std::vector<uint32_t> pageSlots;
+    std::deque<std::array<uint8_t, PAGE_SIZE>> privatePool;
+    // lanes using each copy (more than one after a fork), and the slots no lane uses any more
+    std::vector<uint32_t> slotUsers;
+    std::vector<uint32_t> freeSlots;
+    // bit n set once any lane has a copy of page n; code there has to be read lane by lane
+    uint16_t privatePages{};
+
+    // the machine the lanes were reset from, the base for Extract()
+    std::vector<uint8_t> snapshot;
+
+    unsigned long long instructions{};
+};
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+#include "Batch.hpp"
+#include "Chip8.hpp"
+
+const unsigned int ROMS = 600;
+// more than one block, and not a whole number of them
+const unsigned int LANES = 45;
+const unsigned int FRAMES = 40;
+const unsigned int FORKS_PER_FRAME = 4;
+const unsigned int MAX_ROM_INSTRUCTIONS = 64;
+const unsigned int MAX_CYCLES_PER_FRAME = 40;
+const Quirks PROFILES[] = {Quirks::Vip, Quirks::Chip48, Quirks::Modern};
+
+// Random code weighted towards what lanes run together (arithmetic with VF as an operand, skips, calls and returns),
+// with key tests and Cxkk so lanes split up, and Fx33/Fx55 storing into the code and other pages so lanes stop
+// sharing memory
+static std::vector<uint8_t> MakeRom(std::mt19937& rng) {
+    unsigned int length = 8 + rng() % (MAX_ROM_INSTRUCTIONS - 7);
+    std::vector<uint8_t> rom;
+
+    for (unsigned int i = 0; i < length; ++i) {
+        // VF often, so the flag is both an operand and a result
+        uint16_t x = (rng() % 4 == 0) ? 0xF : rng() % 16;
+        uint16_t y = (rng() % 4 == 0) ? 0xF : rng() % 16;
+        uint16_t kk = (rng() % 3 == 0) ? rng() % 4 : rng() % 256;
+        uint16_t target = 0x200 + 2 * (rng() % length);
+        uint16_t back = 0x200 + 2 * (i - std::min<unsigned int>(i, rng() % 8));
+        // the code itself half the time, otherwise any page past it
+        uint16_t data = (rng() % 2) ? 0x200 + rng() % (2 * length) : 0x200 + rng() % (MEMORY_SIZE - 0x200);
+        uint16_t opcode = 0;
+
+        static const uint16_t arithmetic[] = {0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xE};
+        switch (rng() % 26) {
+            case 0: case 1: opcode = 0x6000u | x << 8u | kk; break;
+            case 2: case 3: opcode = 0x7000u | x << 8u | kk; break;
+            case 4: case 5: case 6: case 7: opcode = 0x8000u | x << 8u | y << 4u | arithmetic[rng() % 9]; break;
+            case 8: opcode = 0x3000u | x << 8u | kk; break;
+            case 9: opcode = 0x4000u | x << 8u | kk; break;
+            case 10: opcode = ((rng() % 2) ? 0x5000u : 0x9000u) | x << 8u | y << 4u; break;
+            case 11: opcode = 0x1000u | back; break;
+            case 12: opcode = 0x1000u | target; break;
+            case 13: case 14: opcode = 0x2000u | target; break;
+            case 15: opcode = 0x00EEu; break;
+            case 16: case 17: opcode = 0xA000u | data; break;
+            case 18: opcode = 0xF01Eu | x << 8u; break;
+            case 19: opcode = 0xF000u | x << 8u | ((rng() % 2) ? 0x07u : 0x15u); break;
+            case 20: opcode = 0xF029u | x << 8u; break;
+            case 21: opcode = 0xB000u | target; break;
+            case 22: opcode = 0xD000u | x << 8u | y << 4u | (rng() % 6); break;
+            case 23: opcode = 0xC000u | x << 8u | kk; break;
+            case 24: opcode = 0xE000u | x << 8u | ((rng() % 2) ? 0x9Eu : 0xA1u); break;
+            default: {
+                static const uint16_t memoryOps[] = {0xF033, 0xF033, 0xF055, 0xF055, 0xF065, 0xF00A};
+                opcode = memoryOps[rng() % 6] | (rng() % 16) << 8u;
+                break;
+            }
+        }
+        rom.push_back(static_cast<uint8_t>(opcode >> 8u));
+        rom.push_back(static_cast<uint8_t>(opcode & 0xFFu));
+    }
+
+    return rom;
+}
+
+// Makes child a copy of parent in the batch and among the reference machines. A snapshot leaves out a parked Fx0A,
+// which parks again when the machine next runs, so until then it is kept in parked
+static void Fork(Batch& batch, std::vector<std::unique_ptr<Chip8>>& reference, std::vector<bool>& parked,
+                 std::mt19937& rng, std::vector<uint8_t>& state) {
+    unsigned int parent = rng() % LANES;
+    unsigned int child = rng() % LANES;
+
+    batch.Fork(parent, child);
+    // read first, parent and child may be the same lane
+    bool waiting = parked[parent] || reference[parent]->IsWaitingForKey();
+    reference[parent]->SaveState(state.data());
+    reference[child]->LoadState(state.data(), reference[parent]->GetStateSize());
+    reference[child]->SetKeys(reference[parent]->GetKeys());
+    parked[child] = waiting;
+}
+
+// Runs cycles instructions on every reference machine
+static void Run(std::vector<std::unique_ptr<Chip8>>& reference, std::vector<bool>& parked, unsigned int cycles) {
+    if (cycles == 0) {
+        return;
+    }
+
+    for (unsigned int lane = 0; lane < LANES; ++lane) {
+        reference[lane]->Run(cycles);
+        parked[lane] = false;
+    }
+}
+
+// Runs random ROMs on a batch and on one machine per lane, with every lane's own keys and seed and forks between
+// runs, and compares every lane copied back out with its machine after every frame
+int main() {
+    std::mt19937 rng(1);
+    std::vector<uint8_t> expected(Chip8::GetStateSize(Quirks::Modern));
+    std::vector<uint8_t> actual(expected.size());
+    unsigned int failures = 0;
+
+    std::cout << (Batch::IsVectorized() ? "vectorized" : "lane by lane") << " build\n";
+
+    for (unsigned int i = 0; i < ROMS && failures == 0; ++i)
+    {
+        std::vector<uint8_t> rom = MakeRom(rng);
+        Quirks quirks = PROFILES[i % (sizeof(PROFILES) / sizeof(PROFILES[0]))];
+        unsigned int cyclesPerFrame = 1 + rng() % MAX_CYCLES_PER_FRAME;
+
+        Chip8 loaded(1);
+        loaded.SetQuirks(quirks);
+        loaded.LoadROM(rom.data(), rom.size());
+        Batch batch(LANES);
+        batch.Reset(loaded);
+
+        std::vector<std::unique_ptr<Chip8>> reference;
+        std::vector<bool> parked(LANES);
+        for (unsigned int lane = 0; lane < LANES; ++lane)
+        {
+            reference.emplace_back(new Chip8(1 + i * LANES + lane));
+            reference[lane]->SetQuirks(quirks);
+            reference[lane]->LoadROM(rom.data(), rom.size());
+            batch.SetSeed(lane, 1 + i * LANES + lane);
+        }
+
+        for (unsigned int frame = 0; frame < FRAMES && failures == 0; ++frame)
+        {
+            for (unsigned int lane = 0; lane < LANES; ++lane)
+            {
+                // mostly one key down, sometimes none, so Fx0A parks and resumes
+                uint16_t keys = (rng() % 3 == 0) ? 0 : static_cast<uint16_t>(1u << (rng() % 16));
+                reference[lane]->SetKeys(keys);
+                batch.SetKeys(lane, keys);
+            }
+
+            // forks halfway through a frame as well as between frames
+            unsigned int first = rng() % (cyclesPerFrame + 1);
+            batch.Run(first);
+            Run(reference, parked, first);
+            for (unsigned int fork = 0; fork < FORKS_PER_FRAME; ++fork)
+            {
+                Fork(batch, reference, parked, rng, expected);
+            }
+            batch.Run(cyclesPerFrame - first);
+            batch.TickTimers();
+            Run(reference, parked, cyclesPerFrame - first);
+            for (auto& chip8 : reference)
+            {
+                chip8->TickTimers();
+            }
+
+            for (unsigned int lane = 0; lane < LANES; ++lane)
+            {
+                Chip8 extracted(0);
+                batch.Extract(lane, extracted);
+                size_t size = reference[lane]->GetStateSize();
+                reference[lane]->SaveState(expected.data());
+                extracted.SaveState(actual.data());
+                if (memcmp(expected.data(), actual.data(), size) != 0
+                    || batch.IsWaitingForKey(lane) != (parked[lane] || reference[lane]->IsWaitingForKey()))
+                {
+                    std::cerr << "ROM " << i << " (" << GetQuirksName(quirks) << ", " << cyclesPerFrame
+                              << " cycles/frame), frame " << frame << ": lane " << lane << " differs\n";
+                    ++failures;
+                    break;
+                }
+            }
+
+            for (unsigned int fork = 0; fork < FORKS_PER_FRAME; ++fork)
+            {
+                Fork(batch, reference, parked, rng, expected);
+            }
+        }
+
+        if (batch.GetPrivatePages() > LANES * Batch::PAGE_COUNT)
+        {
+            std::cerr << "ROM " << i << ": " << batch.GetPrivatePages() << " page copies for " << LANES
+                      << " lanes\n";
+            ++failures;
+        }
+    }
+
+    std::cout << (failures ? "FAILED" : "passed") << "\n";
+
+    return failures ? EXIT_FAILURE : 0;
+}
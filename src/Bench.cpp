@@ -0,0 +1,545 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Batch.hpp"
+#include "Chip8.hpp"
+#include "Jit.hpp"
+
+// every machine is seeded identically so Cxkk-heavy workloads do the same work in every build
+const unsigned int BENCH_SEED = 1;
+const unsigned int ROM_START = 0x200;
+// how many copies of the measured instruction each synthetic loop body holds
+const unsigned int KERNEL_COPIES = 64;
+// instructions per timed run of a kernel, and frames per timed run of a whole program
+const unsigned long long KERNEL_CYCLES = 20000000;
+const unsigned long long PROGRAM_FRAMES = 200000;
+// iterations of the startup measurements
+const unsigned int STARTUP_ITERATIONS = 20000;
+
+// One measurement; value is the figure of merit in unit, seconds the best of the timed repeats
+struct Result {
+    std::string name;
+    std::string engine;
+    unsigned long long iterations;
+    double seconds;
+    double value;
+    char const* unit;
+};
+
+// A ROM image to benchmark, either synthetic or read from disk
+struct Program {
+    std::string name;
+    std::vector<uint8_t> rom;
+};
+
+static void Append(std::vector<uint8_t>& rom, uint16_t opcode) {
+    rom.push_back(opcode >> 8u);
+    rom.push_back(opcode & 0xFFu);
+}
+
+// setup once, then the body KERNEL_COPIES times followed by a jump back, so nearly every instruction run is the body
+static Program MakeKernel(char const* name, std::vector<uint16_t> const& setup, std::vector<uint16_t> const& body) {
+    Program program{name, {}};
+
+    for (uint16_t opcode : setup) {
+        Append(program.rom, opcode);
+    }
+
+    uint16_t loop = ROM_START + program.rom.size();
+    for (unsigned int copy = 0; copy < KERNEL_COPIES; ++copy) {
+        for (uint16_t opcode : body) {
+            Append(program.rom, opcode);
+        }
+    }
+    Append(program.rom, 0x1000u | loop);
+
+    return program;
+}
+
+// call/return pairs: every 2nnn targets a subroutine that is a single 00EE
+static Program MakeCallKernel() {
+    Program program{"2nnn/00EE call", {}};
+
+    uint16_t subroutine = ROM_START + 2 * (KERNEL_COPIES + 1);
+    for (unsigned int copy = 0; copy < KERNEL_COPIES; ++copy) {
+        Append(program.rom, 0x2000u | subroutine);
+    }
+    Append(program.rom, 0x1000u | ROM_START);
+    Append(program.rom, 0x00EE);
+
+    return program;
+}
+
+// skip-over-jump pairs as compiled loop tests emit them: every skip fails and its 1nnn jumps to the next pair
+static Program MakeSkipJumpKernel() {
+    Program program{"3xkk+1nnn skip over jump", {}};
+
+    for (unsigned int copy = 0; copy < KERNEL_COPIES; ++copy) {
+        uint16_t next = ROM_START + program.rom.size() + 4;
+        Append(program.rom, 0x3AFF);
+        Append(program.rom, 0x1000u | next);
+    }
+    Append(program.rom, 0x1000u | ROM_START);
+
+    return program;
+}
+
+// one kernel per instruction family worth tracking
+static std::vector<Program> MakeKernels() {
+    std::vector<Program> kernels;
+
+    kernels.push_back(MakeKernel("6xkk load", {}, {0x6A12}));
+    kernels.push_back(MakeKernel("7xkk add", {}, {0x7A01}));
+    kernels.push_back(MakeKernel("8xy4 add with carry", {0x6A01, 0x6B03}, {0x8AB4}));
+    kernels.push_back(MakeKernel("8xy6 shift", {0x6BAA}, {0x8AB6}));
+    kernels.push_back(MakeKernel("3xkk skip not taken", {}, {0x3AFF}));
+    kernels.push_back(MakeKernel("Annn set index", {}, {0xA300}));
+    kernels.push_back(MakeKernel("Fx1E add to index", {0xA300}, {0xFA1E}));
+    kernels.push_back(MakeKernel("Cxkk random", {}, {0xCAFF}));
+    kernels.push_back(MakeKernel("Dxyn draw", {0xA050, 0x6A1C, 0x6B0D}, {0xDAB5}));
+    kernels.push_back(MakeKernel("Dxyn draw clipped", {0xA050, 0x6A3C, 0x6B1E}, {0xDAB5}));
+    kernels.push_back(MakeKernel("Ex9E key", {}, {0xEA9E}));
+    kernels.push_back(MakeKernel("Fx07 read delay timer", {}, {0xFA07}));
+    kernels.push_back(MakeKernel("Fx33 BCD", {0xA400, 0x6AFE}, {0xFA33}));
+    kernels.push_back(MakeKernel("Fx55 store V0-VF", {0xA400}, {0xFF55}));
+    kernels.push_back(MakeKernel("Fx65 load V0-VF", {0xA400}, {0xFF65}));
+    kernels.push_back(MakeCallKernel());
+    // sequences the interpreter runs as one fused operation
+    kernels.push_back(MakeSkipJumpKernel());
+    kernels.push_back(MakeKernel("Annn+Dxyn draw", {0x6A1C, 0x6B0D}, {0xA050, 0xDAB5}));
+    kernels.push_back(MakeKernel("6xkk+Fx29+Dxyn draw digit", {0x6A1C, 0x6B0D}, {0x6C07, 0xFC29, 0xDAB5}));
+    kernels.push_back(MakeKernel("Fx1E+Fx55+Fx1E store", {0xA400, 0x6E00}, {0xFE1E, 0xF355, 0xFE1E}));
+    kernels.push_back(MakeKernel("Fx1E+Fx65+Fx1E load", {0xA400, 0x6E00}, {0xFE1E, 0xF365, 0xFE1E}));
+
+    return kernels;
+}
+
+// a small game-like loop: random sprite positions, font lookups, drawing, a key check and a timer read
+static Program MakeMixedProgram() {
+    Program program{"mixed", {}};
+    uint16_t const code[] = {
+        0x630F,         // V3 = 0x0F
+        0xC03F, 0xC11F, // V0, V1 = random position
+        0xF229,         // I = glyph for V2
+        0xD015,         // draw it
+        0x7201,         // V2 += 1
+        0x8232,         // V2 &= V3
+        0xE29E,         // skip if key V2 is down
+        0xF407,         // V4 = delay timer
+        0x1202,         // loop
+    };
+
+    for (uint16_t opcode : code) {
+        Append(program.rom, opcode);
+    }
+
+    return program;
+}
+
+static bool ReadFile(char const* filename, std::vector<uint8_t>& data) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+static double Seconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// best of repeats runs of KERNEL_CYCLES instructions, after one untimed run to warm the caches and the JIT
+static Result MeasureKernel(Program const& kernel, bool useJit, unsigned int repeats) {
+    Chip8 chip8(BENCH_SEED);
+    chip8.LoadROM(kernel.rom.data(), kernel.rom.size());
+
+    std::unique_ptr<Jit> jit;
+    if (useJit) {
+        jit.reset(new Jit(chip8));
+    }
+
+    auto run = [&](unsigned long long cycles) {
+        if (jit) {
+            jit->Run(cycles);
+        } else {
+            chip8.Run(static_cast<unsigned int>(cycles));
+        }
+    };
+
+    run(KERNEL_CYCLES / 10);
+
+    double best = 0.0;
+    unsigned long long instructions = 0;
+    for (unsigned int repeat = 0; repeat < repeats; ++repeat) {
+        unsigned long long before = chip8.GetInstructions();
+        auto start = std::chrono::steady_clock::now();
+        run(KERNEL_CYCLES);
+        double seconds = Seconds(start);
+        if (repeat == 0 || seconds < best) {
+            best = seconds;
+            instructions = chip8.GetInstructions() - before;
+        }
+    }
+
+    char const* engine = useJit ? "jit" : "interpreter";
+
+    return Result{kernel.name, engine, instructions, best, instructions / best / 1e6, "MIPS"};
+}
+
+// best of repeats runs of PROGRAM_FRAMES frames, unthrottled, timers ticking once per frame
+static std::vector<Result> MeasureProgram(Program const& program, bool useJit, unsigned int repeats) {
+    double best = 0.0;
+    unsigned long long instructions = 0;
+
+    for (unsigned int repeat = 0; repeat < repeats; ++repeat) {
+        Chip8 chip8(BENCH_SEED);
+        chip8.LoadROM(program.rom.data(), program.rom.size());
+
+        std::unique_ptr<Jit> jit;
+        if (useJit) {
+            jit.reset(new Jit(chip8));
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned long long frame = 0; frame < PROGRAM_FRAMES; ++frame) {
+            if (jit) {
+                jit->Run(DEFAULT_CYCLES_PER_FRAME);
+                chip8.TickTimers();
+            } else {
+                chip8.RunFrame(DEFAULT_CYCLES_PER_FRAME);
+            }
+        }
+        double seconds = Seconds(start);
+        if (repeat == 0 || seconds < best) {
+            best = seconds;
+            instructions = chip8.GetInstructions();
+        }
+    }
+
+    // as for the batch, a machine parked on Fx0A or in a skipped idle loop runs fewer instructions than its frames
+    char const* engine = useJit ? "jit" : "interpreter";
+
+    return {
+        Result{program.name, engine, PROGRAM_FRAMES, best, PROGRAM_FRAMES / best, "frames/s"},
+        Result{program.name, engine, instructions, best, instructions / best / 1e6, "MIPS"},
+    };
+}
+
+// a batch of lanes copied from one loaded machine, each reseeded so Cxkk sends them different ways
+static std::unique_ptr<Batch> MakeBatch(Program const& program, unsigned int lanes) {
+    Chip8 chip8(BENCH_SEED);
+    chip8.LoadROM(program.rom.data(), program.rom.size());
+
+    std::unique_ptr<Batch> batch(new Batch(lanes));
+    batch->Reset(chip8);
+    for (unsigned int lane = 0; lane < lanes; ++lane) {
+        batch->SetSeed(lane, BENCH_SEED + lane);
+    }
+
+    return batch;
+}
+
+// MeasureKernel() on the batch engine: the same number of instructions, shared out between the lanes
+static Result MeasureBatchKernel(Program const& kernel, unsigned int lanes, unsigned int repeats) {
+    std::unique_ptr<Batch> batch = MakeBatch(kernel, lanes);
+    unsigned int cycles = static_cast<unsigned int>(KERNEL_CYCLES / lanes);
+
+    batch->Run(cycles / 10);
+
+    double best = 0.0;
+    unsigned long long instructions = 0;
+    for (unsigned int repeat = 0; repeat < repeats; ++repeat) {
+        unsigned long long before = batch->GetInstructions();
+        auto start = std::chrono::steady_clock::now();
+        batch->Run(cycles);
+        double seconds = Seconds(start);
+        if (repeat == 0 || seconds < best) {
+            best = seconds;
+            instructions = batch->GetInstructions() - before;
+        }
+    }
+
+    return Result{kernel.name, "batch", instructions, best, instructions / best / 1e6, "MIPS"};
+}
+
+// MeasureProgram() on the batch engine; every lane runs PROGRAM_FRAMES / lanes frames
+static std::vector<Result> MeasureBatchProgram(Program const& program, unsigned int lanes, unsigned int repeats) {
+    unsigned long long frames = std::max(1ull, PROGRAM_FRAMES / lanes);
+    double best = 0.0;
+    unsigned long long instructions = 0;
+
+    for (unsigned int repeat = 0; repeat < repeats; ++repeat) {
+        std::unique_ptr<Batch> batch = MakeBatch(program, lanes);
+
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned long long frame = 0; frame < frames; ++frame) {
+            batch->RunFrame(DEFAULT_CYCLES_PER_FRAME);
+        }
+        double seconds = Seconds(start);
+        if (repeat == 0 || seconds < best) {
+            best = seconds;
+            instructions = batch->GetInstructions();
+        }
+    }
+
+    // frames and instructions summed over the lanes; a lane parked on Fx0A runs fewer instructions than its frames
+    unsigned long long laneFrames = frames * lanes;
+
+    return {
+        Result{program.name, "batch", laneFrames, best, laneFrames / best, "frames/s"},
+        Result{program.name, "batch", instructions, best, instructions / best / 1e6, "MIPS"},
+    };
+}
+
+// cost of Batch::Fork() once the lanes have run for a while and hold page copies of their own
+static Result MeasureFork(Program const& program, unsigned int lanes) {
+    std::unique_ptr<Batch> batch = MakeBatch(program, lanes);
+    for (unsigned int frame = 0; frame < 100; ++frame) {
+        batch->RunFrame(DEFAULT_CYCLES_PER_FRAME);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < STARTUP_ITERATIONS; ++i) {
+        batch->Fork(i % lanes, (i * 7 + 1) % lanes);
+    }
+    double seconds = Seconds(start);
+
+    return Result{"fork " + program.name, "batch", STARTUP_ITERATIONS, seconds, seconds / STARTUP_ITERATIONS * 1e9, "ns/op"};
+}
+
+// cost of constructing a machine, heap allocated as a real frontend or fleet would
+static Result MeasureConstruction() {
+    // the volatile read keeps the work from being optimised away
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < STARTUP_ITERATIONS; ++i) {
+        std::unique_ptr<Chip8> chip8(new Chip8(BENCH_SEED + i));
+        volatile uint16_t pc = chip8->GetPC();
+        (void)pc;
+    }
+    double seconds = Seconds(start);
+
+    return Result{"construct Chip8", "-", STARTUP_ITERATIONS, seconds, seconds / STARTUP_ITERATIONS * 1e9, "ns/op"};
+}
+
+// cost of constructing a machine and loading it with an image other machines already share, as a fleet does for
+// every copy of a ROM
+static Result MeasureSharedConstruction(Program const& program) {
+    std::shared_ptr<Chip8::Image const> image = Chip8::MakeImage(program.rom.data(), program.rom.size());
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < STARTUP_ITERATIONS; ++i) {
+        std::unique_ptr<Chip8> chip8(new Chip8(BENCH_SEED + i));
+        chip8->LoadROM(image);
+        volatile uint16_t pc = chip8->GetPC();
+        (void)pc;
+    }
+    double seconds = Seconds(start);
+
+    return Result{"construct+LoadROM image " + program.name, "-", STARTUP_ITERATIONS, seconds, seconds / STARTUP_ITERATIONS * 1e9, "ns/op"};
+}
+
+// bytes a machine takes on its own, once loaded and once the program has run for a while (and perhaps stored to
+// memory); the shared image is counted once, whatever the number of machines
+static std::vector<Result> MeasureFootprint(Program const& program) {
+    Chip8 chip8(BENCH_SEED);
+    chip8.LoadROM(program.rom.data(), program.rom.size());
+    size_t loaded = chip8.GetFootprint();
+    for (unsigned int frame = 0; frame < 1000; ++frame) {
+        chip8.RunFrame(DEFAULT_CYCLES_PER_FRAME);
+    }
+
+    return {
+        Result{"footprint loaded " + program.name, "-", 1, 0.0, static_cast<double>(loaded), "bytes"},
+        Result{"footprint after 1000 frames " + program.name, "-", 1, 0.0, static_cast<double>(chip8.GetFootprint()), "bytes"},
+    };
+}
+
+// cost of loading a ROM into an existing machine, from memory and, when there is one, from its file
+static std::vector<Result> MeasureLoadROM(Program const& program, char const* filename) {
+    std::vector<Result> results;
+
+    Chip8 chip8(BENCH_SEED);
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < STARTUP_ITERATIONS; ++i) {
+        chip8.LoadROM(program.rom.data(), program.rom.size());
+    }
+    double seconds = Seconds(start);
+    results.push_back(Result{"LoadROM buffer " + program.name, "-", STARTUP_ITERATIONS, seconds, seconds / STARTUP_ITERATIONS * 1e9, "ns/op"});
+
+    if (filename) {
+        start = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < STARTUP_ITERATIONS; ++i) {
+            chip8.LoadROM(filename);
+        }
+        seconds = Seconds(start);
+        results.push_back(Result{"LoadROM file " + program.name, "-", STARTUP_ITERATIONS, seconds, seconds / STARTUP_ITERATIONS * 1e9, "ns/op"});
+    }
+
+    return results;
+}
+
+// quotes a string for JSON output
+static std::string Quote(std::string const& text) {
+    std::string quoted = "\"";
+
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            quoted += ' ';
+        } else {
+            quoted += c;
+        }
+    }
+
+    return quoted + "\"";
+}
+
+static void PrintJson(std::vector<Result> const& results) {
+    std::cout << "{\n  \"seed\": " << BENCH_SEED << ",\n  \"results\": [\n";
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        Result const& result = results[i];
+        std::cout << "    {\"name\": " << Quote(result.name)
+                  << ", \"engine\": " << Quote(result.engine)
+                  << ", \"iterations\": " << result.iterations
+                  << ", \"seconds\": " << result.seconds
+                  << ", \"value\": " << result.value
+                  << ", \"unit\": " << Quote(result.unit) << "}"
+                  << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+
+    std::cout << "  ]\n}\n";
+}
+
+// names are quoted so ROM paths containing commas survive
+static void PrintCsv(std::vector<Result> const& results) {
+    std::cout << "name,engine,iterations,seconds,value,unit\n";
+
+    for (Result const& result : results) {
+        std::cout << Quote(result.name) << "," << result.engine << "," << result.iterations << ","
+                  << result.seconds << "," << result.value << "," << result.unit << "\n";
+    }
+}
+
+int main(int argc, char** argv) {
+    // options come before the ROM files
+    bool csv = false;
+    bool withJit = false;
+    unsigned int repeats = 3;
+    unsigned int batchLanes = 0;
+    int arg = 1;
+    while (arg < argc && std::strncmp(argv[arg], "--", 2) == 0)
+    {
+        if (std::strcmp(argv[arg], "--csv") == 0)
+        {
+            csv = true;
+        }
+        else if (std::strcmp(argv[arg], "--jit") == 0)
+        {
+            withJit = true;
+        }
+        else if (std::strcmp(argv[arg], "--repeat") == 0 && arg + 1 < argc)
+        {
+            repeats = std::max(1ul, std::stoul(argv[++arg]));
+        }
+        else if (std::strcmp(argv[arg], "--batch") == 0 && arg + 1 < argc)
+        {
+            batchLanes = std::max(1ul, std::stoul(argv[++arg]));
+        }
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--csv] [--jit] [--batch <Lanes>] [--repeat <Count>] [ROM...]\n";
+            std::exit(EXIT_FAILURE);
+        }
+        ++arg;
+    }
+
+    // the built-in mixed program always runs, any ROMs given are measured the same way
+    std::vector<Program> programs{MakeMixedProgram()};
+    std::vector<char const*> filenames{nullptr};
+    for (; arg < argc; ++arg)
+    {
+        Program program{argv[arg], {}};
+        if (!ReadFile(argv[arg], program.rom) || program.rom.size() > MEMORY_SIZE - ROM_START)
+        {
+            std::cerr << "Could not load ROM '" << argv[arg] << "'\n";
+            std::exit(EXIT_FAILURE);
+        }
+        programs.push_back(program);
+        filenames.push_back(argv[arg]);
+    }
+
+    std::vector<bool> engines{false};
+    if (withJit)
+    {
+        engines.push_back(true);
+    }
+
+    std::vector<Result> results;
+
+    // micro: one instruction family at a time
+    for (Program const& kernel : MakeKernels())
+    {
+        for (bool useJit : engines)
+        {
+            results.push_back(MeasureKernel(kernel, useJit, repeats));
+        }
+        if (batchLanes)
+        {
+            results.push_back(MeasureBatchKernel(kernel, batchLanes, repeats));
+        }
+    }
+
+    // macro: whole programs at the default instruction rate
+    for (Program const& program : programs)
+    {
+        for (bool useJit : engines)
+        {
+            std::vector<Result> programResults = MeasureProgram(program, useJit, repeats);
+            results.insert(results.end(), programResults.begin(), programResults.end());
+        }
+        if (batchLanes)
+        {
+            std::vector<Result> batchResults = MeasureBatchProgram(program, batchLanes, repeats);
+            results.insert(results.end(), batchResults.begin(), batchResults.end());
+        }
+    }
+
+    // startup: construction, then LoadROM, footprint (and with --batch, forking a lane) per program
+    results.push_back(MeasureConstruction());
+    results.push_back(Result{"footprint image", "-", 1, 0.0, static_cast<double>(Chip8::GetImageFootprint()), "bytes"});
+    for (size_t i = 0; i < programs.size(); ++i)
+    {
+        std::vector<Result> loadResults = MeasureLoadROM(programs[i], filenames[i]);
+        results.insert(results.end(), loadResults.begin(), loadResults.end());
+        results.push_back(MeasureSharedConstruction(programs[i]));
+        std::vector<Result> footprintResults = MeasureFootprint(programs[i]);
+        results.insert(results.end(), footprintResults.begin(), footprintResults.end());
+        if (batchLanes)
+        {
+            results.push_back(MeasureFork(programs[i], batchLanes));
+        }
+    }
+
+    if (csv)
+    {
+        PrintCsv(results);
+    }
+    else
+    {
+        PrintJson(results);
+    }
+
+    return 0;
+}
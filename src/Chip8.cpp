@@ -1,13 +1,28 @@
+#include <algorithm>
+#include <cstring>
 #include <fstream>
+#include <iterator>
+#include <vector>
 #include <chrono>
-#include <random>
 #include "Chip8.hpp"
+#include "Profiler.hpp"
+#include "Trace.hpp"
 
 const unsigned int START_ADDRESS = 0x200;
 const unsigned int FONTSET_SIZE = 80;
-const unsigned int FONTSET_START_ADDRESS = 0x50;
-
-uint8_t fontset[FONTSET_SIZE] = {
+// SUPER-CHIP 8x10 digits, placed right after the small ones
+const unsigned int BIG_FONTSET_SIZE = 160;
+const unsigned int BIG_FONTSET_START_ADDRESS = FONTSET_START_ADDRESS + FONTSET_SIZE;
+// backward jumps spanning at most this many bytes are checked for idle loops; a pass may run this many instructions
+const unsigned int IDLE_LOOP_BYTES = 32;
+const unsigned int IDLE_LOOP_LENGTH = 16;
+// probing runs a pass several times slower than Run would, so it is only worth it with this many passes of budget left
+const unsigned int IDLE_LOOP_PROBE_PASSES = 4;
+// bit for I in the access masks of idle-loop instructions, after V0-VF
+const uint32_t IDLE_ACCESS_INDEX = 1u << 16;
+
+// read-only; copied into every image, which machines share
+const uint8_t fontset[FONTSET_SIZE] = {
 	0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
 	0x20, 0x60, 0x20, 0x20, 0x70, // 1
 	0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
@@ -26,114 +41,474 @@ uint8_t fontset[FONTSET_SIZE] = {
 	0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
 
-Chip8::Chip8() 
-    : randGen(std::chrono::system_clock::now().time_since_epoch().count()) {
+// SUPER-CHIP 1.1 large digits, with the XO-CHIP A-F added
+const uint8_t bigFontset[BIG_FONTSET_SIZE] = {
+	0x3C, 0x7E, 0xE7, 0xC3, 0xC3, 0xC3, 0xC3, 0xE7, 0x7E, 0x3C, // 0
+	0x18, 0x38, 0x58, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x3C, // 1
+	0x3E, 0x7F, 0xC3, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xFF, 0xFF, // 2
+	0x3C, 0x7E, 0xC3, 0x03, 0x0E, 0x0E, 0x03, 0xC3, 0x7E, 0x3C, // 3
+	0x06, 0x0E, 0x1E, 0x36, 0x66, 0xC6, 0xFF, 0xFF, 0x06, 0x06, // 4
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFE, 0x03, 0xC3, 0x7E, 0x3C, // 5
+	0x3E, 0x7C, 0xC0, 0xC0, 0xFC, 0xFE, 0xC3, 0xC3, 0x7E, 0x3C, // 6
+	0xFF, 0xFF, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x60, 0x60, // 7
+	0x3C, 0x7E, 0xC3, 0xC3, 0x7E, 0x7E, 0xC3, 0xC3, 0x7E, 0x3C, // 8
+	0x3C, 0x7E, 0xC3, 0xC3, 0x7F, 0x3F, 0x03, 0x03, 0x3E, 0x7C, // 9
+	0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+	0xFE, 0xFF, 0xC3, 0xC3, 0xFE, 0xFE, 0xC3, 0xC3, 0xFF, 0xFE, // B
+	0x3C, 0x7E, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0x7E, 0x3C, // C
+	0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+};
+
+// handler for every decoded opcode id, shared by all instances; order must match Chip8::Op.
+// Opcodes outside the profile's instruction set do what they did on that interpreter: nothing, or 5xy0 for 5xyn
+template <Quirks Q>
+const Chip8::Chip8Func Chip8::opTable[static_cast<size_t>(Op::Count)] = {
+    &Chip8::OP_NULL, // Undecoded, never dispatched
+    &Chip8::OP_NULL,
+    &Chip8::OP_00E0,
+    &Chip8::OP_00EE,
+    &Chip8::OP_1nnn,
+    &Chip8::OP_2nnn,
+    &Chip8::OP_3xkk<Q>,
+    &Chip8::OP_4xkk<Q>,
+    &Chip8::OP_5xy0<Q>,
+    &Chip8::OP_6xkk,
+    &Chip8::OP_7xkk,
+    &Chip8::OP_8xy0,
+    &Chip8::OP_8xy1<Q>,
+    &Chip8::OP_8xy2<Q>,
+    &Chip8::OP_8xy3<Q>,
+    &Chip8::OP_8xy4,
+    &Chip8::OP_8xy5,
+    &Chip8::OP_8xy6<Q>,
+    &Chip8::OP_8xy7,
+    &Chip8::OP_8xyE<Q>,
+    &Chip8::OP_9xy0<Q>,
+    &Chip8::OP_Annn,
+    &Chip8::OP_Bnnn<Q>,
+    &Chip8::OP_Cxkk,
+    &Chip8::OP_Dxyn<Q>,
+    &Chip8::OP_Ex9E<Q>,
+    &Chip8::OP_ExA1<Q>,
+    &Chip8::OP_Fx07,
+    &Chip8::OP_Fx0A,
+    &Chip8::OP_Fx15,
+    &Chip8::OP_Fx18,
+    &Chip8::OP_Fx1E,
+    &Chip8::OP_Fx29,
+    &Chip8::OP_Fx33<Q>,
+    &Chip8::OP_Fx55<Q>,
+    &Chip8::OP_Fx65<Q>,
+    HasInstructionSet(Q, InstructionSet::SuperChip) ? &Chip8::OP_00Cn : &Chip8::OP_NULL,
+    HasInstructionSet(Q, InstructionSet::XoChip) ? &Chip8::OP_00Dn : &Chip8::OP_NULL,
+    HasInstructionSet(Q, InstructionSet::SuperChip) ? &Chip8::OP_00FB : &Chip8::OP_NULL,
+    HasInstructionSet(Q, InstructionSet::SuperChip) ? &Chip8::OP_00FC : &Chip8::OP_NULL,
+    HasInstructionSet(Q, InstructionSet::SuperChip) ? &Chip8::OP_00FD : &Chip8::OP_NULL,
+    HasInstructionSet(Q, InstructionSet::SuperChip) ? &Chip8::OP_00FE : &Chip8::OP_NULL,
+    HasInstructionSet(Q, InstructionSet::SuperChip) ? &Chip8::OP_00FF : &Chip8::OP_NULL,
+    HasInstructionSet(Q, InstructionSet::XoChip) ? &Chip8::OP_5xy2 : &Chip8::OP_5xy0<Q>,
+    HasInstructionSet(Q, InstructionSet::XoChip) ? &Chip8::OP_5xy3 : &Chip8::OP_5xy0<Q>,
+    HasInstructionSet(Q, InstructionSet::XoChip) ? &Chip8::OP_F000 : &Chip8::OP_NULL,
+    HasInstructionSet(Q, InstructionSet::XoChip) ? &Chip8::OP_Fn01 : &Chip8::OP_NULL,
+    HasInstructionSet(Q, InstructionSet::XoChip) ? &Chip8::OP_F002 : &Chip8::OP_NULL,
+    HasInstructionSet(Q, InstructionSet::SuperChip) ? &Chip8::OP_Fx30 : &Chip8::OP_NULL,
+    HasInstructionSet(Q, InstructionSet::XoChip) ? &Chip8::OP_Fx3A : &Chip8::OP_NULL,
+    HasInstructionSet(Q, InstructionSet::SuperChip) ? &Chip8::OP_Fx75 : &Chip8::OP_NULL,
+    HasInstructionSet(Q, InstructionSet::SuperChip) ? &Chip8::OP_Fx85 : &Chip8::OP_NULL,
+    // fused sequences, stepped one instruction at a time
+    &Chip8::OP_3xkk<Q>,
+    &Chip8::OP_4xkk<Q>,
+    &Chip8::OP_5xy0<Q>,
+    &Chip8::OP_9xy0<Q>,
+    &Chip8::OP_Annn,
+    &Chip8::OP_6xkk,
+    &Chip8::OP_Fx1E,
+    &Chip8::OP_Fx1E,
+};
+
+// command-line name of every profile, indexed by Quirks
+static char const* const QUIRKS_NAMES[static_cast<size_t>(Quirks::Count)] = {"vip", "chip48", "schip", "modern", "xochip"};
+
+bool ParseQuirks(char const* name, Quirks& quirks) {
+    for (size_t i = 0; i < static_cast<size_t>(Quirks::Count); ++i) {
+        if (strcmp(name, QUIRKS_NAMES[i]) == 0) {
+            quirks = static_cast<Quirks>(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+char const* GetQuirksName(Quirks quirks) {
+    return QUIRKS_NAMES[static_cast<size_t>(quirks)];
+}
+
+Chip8::Chip8()
+    : Chip8(static_cast<unsigned int>(std::chrono::system_clock::now().time_since_epoch().count())) {}
+
+struct Chip8::Image {
+    // sized for XO-CHIP, so one image serves every profile
+    uint8_t memory[XO_MEMORY_SIZE]{};
+    Instruction decoded[MEMORY_SIZE]{};
+    size_t romSize{};
+};
+
+// The fonts alone, which a machine starts out with; built on first use and never freed
+static std::shared_ptr<Chip8::Image const> const& GetBlankImage() {
+    static std::shared_ptr<Chip8::Image const> const blank = Chip8::MakeImage(nullptr, 0);
+    return blank;
+}
+
+Chip8::Chip8(unsigned int seed)
+    : rngState(seed != 0 ? seed : 0x9E3779B9u) {
     // initialize pc
     pc = START_ADDRESS;
 
-    // loads fonts into memory
-    for (int i = 0; i < FONTSET_SIZE; i++) {
-        memory[FONTSET_START_ADDRESS + i] = fontset[i];
-    }
-
-    // initialize RNG
-    randByte = std::uniform_int_distribution<uint8_t>(0, 255U);
-
-    // Set up function pointer table
-    table[0x0] = &Chip8::Table0;
-	table[0x1] = &Chip8::OP_1nnn;
-	table[0x2] = &Chip8::OP_2nnn;
-	table[0x3] = &Chip8::OP_3xkk;
-	table[0x4] = &Chip8::OP_4xkk;
-	table[0x5] = &Chip8::OP_5xy0;
-	table[0x6] = &Chip8::OP_6xkk;
-	table[0x7] = &Chip8::OP_7xkk;
-	table[0x8] = &Chip8::Table8;
-	table[0x9] = &Chip8::OP_9xy0;
-	table[0xA] = &Chip8::OP_Annn;
-	table[0xB] = &Chip8::OP_Bnnn;
-	table[0xC] = &Chip8::OP_Cxkk;
-	table[0xD] = &Chip8::OP_Dxyn;
-	table[0xE] = &Chip8::TableE;
-	table[0xF] = &Chip8::TableF;
-
-    // Initialize sub-tables (table0, table8, tableE) to OP_NULL initially
-    for (size_t i = 0; i <= 0xE; i++) {
-		table0[i] = &Chip8::OP_NULL;
-		table8[i] = &Chip8::OP_NULL;
-		tableE[i] = &Chip8::OP_NULL;
-	}
-
-    // Define specific handlers for table0 (0x00E0, 0x00EE)
-    table0[0x0] = &Chip8::OP_00E0;
-	table0[0xE] = &Chip8::OP_00EE;
-
-    // Define handlers for table8 (0x8xy opcodes)
-	table8[0x0] = &Chip8::OP_8xy0;
-	table8[0x1] = &Chip8::OP_8xy1;
-	table8[0x2] = &Chip8::OP_8xy2;
-	table8[0x3] = &Chip8::OP_8xy3;
-	table8[0x4] = &Chip8::OP_8xy4;
-	table8[0x5] = &Chip8::OP_8xy5;
-	table8[0x6] = &Chip8::OP_8xy6;
-	table8[0x7] = &Chip8::OP_8xy7;
-	table8[0xE] = &Chip8::OP_8xyE;
-
-    // Define handlers for tableE (0xExA1, 0xEx9E)
-	tableE[0x1] = &Chip8::OP_ExA1;
-	tableE[0xE] = &Chip8::OP_Ex9E;
-
-    // Initialize tableF (handles 0xFxkk opcodes)
-    for (size_t i = 0; i <= 0x65; i++) {
-		tableF[i] = &Chip8::OP_NULL;
-	}
-
-    // Define handlers for tableF (0xFx opcodes)
-    tableF[0x07] = &Chip8::OP_Fx07;
-	tableF[0x0A] = &Chip8::OP_Fx0A;
-	tableF[0x15] = &Chip8::OP_Fx15;
-	tableF[0x18] = &Chip8::OP_Fx18;
-	tableF[0x1E] = &Chip8::OP_Fx1E;
-	tableF[0x29] = &Chip8::OP_Fx29;
-	tableF[0x33] = &Chip8::OP_Fx33;
-	tableF[0x55] = &Chip8::OP_Fx55;
-	tableF[0x65] = &Chip8::OP_Fx65;
-}
-
-void Chip8::LoadROM(char const* filename) {
-    // opens file in binary mode and sets file pointer to end
+    // the fonts are in the shared blank image, so there is nothing to copy
+    image = GetBlankImage();
+    memory = image->memory;
+    decoded = image->decoded;
+}
+
+std::shared_ptr<Chip8::Image const> Chip8::MakeImage(uint8_t const* data, size_t size) {
+    if (size > XO_MEMORY_SIZE - START_ADDRESS) {
+        return nullptr;
+    }
+
+    std::shared_ptr<Image> image = std::make_shared<Image>();
+    memcpy(image->memory + FONTSET_START_ADDRESS, fontset, FONTSET_SIZE);
+    memcpy(image->memory + BIG_FONTSET_START_ADDRESS, bigFontset, BIG_FONTSET_SIZE);
+    if (size > 0) {
+        memcpy(image->memory + START_ADDRESS, data, size);
+    }
+    image->romSize = size;
+
+    // everything past the ROM is zeros, which decode alike; the last address is left for Fetch(), as its second
+    // byte wraps to address 0 unless the profile is XO-CHIP
+    unsigned int end = static_cast<unsigned int>(std::min<size_t>(START_ADDRESS + size, MEMORY_SIZE - 1));
+    for (unsigned int address = 0; address < end; ++address) {
+        uint16_t opcode = static_cast<uint16_t>((image->memory[address] << 8u) | image->memory[address + 1]);
+        image->decoded[address] = DecodeOpcode(opcode);
+        Fuse(image->memory, static_cast<uint16_t>(address), image->decoded[address]);
+    }
+    std::fill(image->decoded + end, image->decoded + MEMORY_SIZE - 1, DecodeOpcode(0));
+
+    return image;
+}
+
+std::shared_ptr<Chip8::Image const> Chip8::MakeImage(char const* filename) {
     std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        return nullptr;
+    }
+
+    std::streampos size = file.tellg();
+    if (size < 0 || static_cast<size_t>(size) > XO_MEMORY_SIZE - START_ADDRESS) {
+        return nullptr;
+    }
+
+    std::vector<uint8_t> buffer(static_cast<size_t>(size));
+    file.seekg(0, std::ios::beg);
+    file.read(reinterpret_cast<char*>(buffer.data()), size);
+
+    return file ? MakeImage(buffer.data(), buffer.size()) : nullptr;
+}
+
+bool Chip8::LoadROM(char const* filename) {
+    std::shared_ptr<Image const> loaded = MakeImage(filename);
+
+    return loaded && LoadROM(loaded);
+}
+
+bool Chip8::LoadROM(uint8_t const* data, size_t size) {
+    // reject ROMs that would not fit between 0x200 and the end of the profile's memory
+    if (size > GetMemorySize(quirks) - START_ADDRESS) {
+        return false;
+    }
+
+    return LoadROM(MakeImage(data, size));
+}
+
+bool Chip8::LoadROM(std::shared_ptr<Image const> image) {
+    if (!image || image->romSize > GetMemorySize(quirks) - START_ADDRESS) {
+        return false;
+    }
+
+    // memory and its decoding go back to the image's; any copies are kept to be reused by the next store
+    this->image = std::move(image);
+    memory = this->image->memory;
+    decoded = this->image->decoded;
+    ++memoryEpoch;
+    waitingForKey = false;
+
+    return true;
+}
+
+Chip8::Instruction const& Chip8::DecodeCached(uint16_t address) {
+    Unshare();
+    ownDecoded[address] = Decode(address);
+    Fuse(memory, address, ownDecoded[address]);
+
+    return ownDecoded[address];
+}
+
+void Chip8::ReserveOwnMemory() {
+    if (ownMemorySize < GetMemorySize(quirks)) {
+        ownMemory.reset(new uint8_t[GetMemorySize(quirks)]);
+        ownMemorySize = GetMemorySize(quirks);
+    }
+    if (!ownDecoded) {
+        ownDecoded.reset(new Instruction[MEMORY_SIZE]);
+    }
+}
+
+void Chip8::CopyImage() {
+    ReserveOwnMemory();
+    std::copy(memory, memory + GetMemorySize(quirks), ownMemory.get());
+    std::copy(decoded, decoded + MEMORY_SIZE, ownDecoded.get());
+    memory = ownMemory.get();
+    decoded = ownDecoded.get();
+}
+
+size_t Chip8::GetFootprint() const {
+    size_t bytes = sizeof(Chip8);
+    if (ownMemory) {
+        bytes += ownMemorySize + MEMORY_SIZE * sizeof(Instruction);
+    }
+
+    return bytes;
+}
+
+size_t Chip8::GetImageFootprint() {
+    return sizeof(Image);
+}
+
+// snapshot header: magic bytes followed by the format version
+const uint8_t STATE_MAGIC[4] = {'C', '8', 'S', 'T'};
+const uint16_t STATE_VERSION = 3;
+
+// multi-byte fields are stored little-endian so snapshots move between hosts
+static uint8_t* Put16(uint8_t* out, uint16_t value) {
+    out[0] = value & 0xFFu;
+    out[1] = value >> 8u;
+    return out + 2;
+}
+
+static uint16_t Get16(uint8_t const* in) {
+    return static_cast<uint16_t>(in[0] | (in[1] << 8u));
+}
+
+void Chip8::SaveState(uint8_t* buffer) const {
+    uint8_t* out = buffer;
+
+    memcpy(out, STATE_MAGIC, sizeof(STATE_MAGIC));
+    out = Put16(out + sizeof(STATE_MAGIC), STATE_VERSION);
+    // the profile comes first because it decides how much memory follows
+    *out++ = static_cast<uint8_t>(quirks);
+
+    // the large arrays are plain byte copies, which keeps a capture to a few memcpy calls
+    memcpy(out, registers, sizeof(registers));
+    out += sizeof(registers);
 
-    if (file.is_open()) {
-        // get size of file and allocate buffer of that size to hold contents
-        std::streampos size = file.tellg();
-        char* buffer = new char[size];
-        
-        // set file pointer to beginning then fill buffer
-        file.seekg(0, std::ios::beg);
-        file.read(buffer, size);
-        file.close();
-
-        // load ROM contents into CHIP8's memory, starting at 0x200
-        for (int i = 0; i < size; i++) {
-            memory[START_ADDRESS + i] = buffer[i];
+    out = Put16(out, index);
+    out = Put16(out, pc);
+    for (uint16_t entry : stack) {
+        out = Put16(out, entry);
+    }
+    *out++ = sp;
+    *out++ = delayTimer;
+    *out++ = soundTimer;
+    out = Put16(out, rngState & 0xFFFFu);
+    out = Put16(out, rngState >> 16u);
+
+    *out++ = hires;
+    *out++ = planeMask;
+    *out++ = pitch;
+    memcpy(out, userFlags, sizeof(userFlags));
+    out += sizeof(userFlags);
+    memcpy(out, audioPattern, sizeof(audioPattern));
+    out += sizeof(audioPattern);
+
+    for (auto const& plane : video) {
+        for (auto const& row : plane) {
+            for (uint64_t word : row) {
+                for (unsigned int shift = 0; shift < 64; shift += 8) {
+                    *out++ = (word >> shift) & 0xFFu;
+                }
+            }
         }
+    }
+
+    memcpy(out, memory, GetMemorySize(quirks));
+}
+
+bool Chip8::LoadState(uint8_t const* buffer, size_t size) {
+    // refuse anything that is not a snapshot of exactly this version, or whose display mode or planes are impossible
+    size_t const header = sizeof(STATE_MAGIC) + 2;
+    size_t const mode = header + 1 + 16 + 2 + 2 + 16 * 2 + 3 + 4;
+    if (size <= header || memcmp(buffer, STATE_MAGIC, sizeof(STATE_MAGIC)) != 0
+        || Get16(buffer + sizeof(STATE_MAGIC)) != STATE_VERSION
+        || buffer[header] >= static_cast<uint8_t>(Quirks::Count)
+        || size != GetStateSize(static_cast<Quirks>(buffer[header]))
+        || buffer[mode] > 1 || buffer[mode + 1] >= 1u << VIDEO_PLANES) {
+        return false;
+    }
+
+    uint8_t const* in = buffer + header;
+
+    SetQuirks(static_cast<Quirks>(*in++));
+
+    memcpy(registers, in, sizeof(registers));
+    in += sizeof(registers);
+
+    index = Get16(in);
+    pc = Get16(in + 2);
+    in += 4;
+    for (uint16_t& entry : stack) {
+        entry = Get16(in);
+        in += 2;
+    }
+    sp = *in++;
+    delayTimer = *in++;
+    soundTimer = *in++;
+    rngState = Get16(in) | (static_cast<uint32_t>(Get16(in + 2)) << 16u);
+    in += 4;
+
+    hires = *in++;
+    planeMask = *in++;
+    pitch = *in++;
+    memcpy(userFlags, in, sizeof(userFlags));
+    in += sizeof(userFlags);
+    memcpy(audioPattern, in, sizeof(audioPattern));
+    in += sizeof(audioPattern);
+
+    for (auto& plane : video) {
+        for (auto& row : plane) {
+            for (uint64_t& word : row) {
+                word = 0;
+                for (unsigned int shift = 0; shift < 64; shift += 8) {
+                    word |= static_cast<uint64_t>(*in++) << shift;
+                }
+            }
+        }
+    }
+
+    // memory the profile cannot address is not in the snapshot and must not survive from before it, so the image
+    // anything past it comes from, should the profile grow, is the blank one
+    image = GetBlankImage();
+    ReserveOwnMemory();
+    memory = ownMemory.get();
+    decoded = ownDecoded.get();
+    memcpy(ownMemory.get(), in, GetMemorySize(quirks));
+    memset(ownMemory.get() + GetMemorySize(quirks), 0, ownMemorySize - GetMemorySize(quirks));
+
+    // memory was replaced wholesale, and the whole screen has to be presented again
+    std::fill(ownDecoded.get(), ownDecoded.get() + MEMORY_SIZE, Instruction{});
+    ++memoryEpoch;
+    MarkAllRowsDirty();
+    // an Fx0A the snapshot was parked on parks again when it next runs
+    waitingForKey = false;
+
+    return true;
+}
+
+bool Chip8::SaveStateFile(char const* filename) const {
+    std::vector<uint8_t> buffer(GetStateSize());
+    SaveState(buffer.data());
+
+    std::ofstream file(filename, std::ios::binary);
+    file.write(reinterpret_cast<char const*>(buffer.data()), buffer.size());
+
+    return file.good();
+}
+
+bool Chip8::LoadStateFile(char const* filename) {
+    std::ifstream file(filename, std::ios::binary);
+    std::vector<uint8_t> buffer(GetStateSize(Quirks::XoChip) + 1);
+
+    // read one byte more than the largest snapshot so oversized files are rejected too
+    file.read(reinterpret_cast<char*>(buffer.data()), buffer.size());
+
+    return LoadState(buffer.data(), static_cast<size_t>(file.gcount()));
+}
+
+uint64_t Chip8::Checksum() const {
+    std::vector<uint8_t> buffer(GetStateSize());
+    SaveState(buffer.data());
+
+    // 64-bit FNV-1a over the snapshot, so everything a snapshot restores is covered
+    uint64_t hash = 14695981039346656037ull;
+    for (uint8_t byte : buffer) {
+        hash ^= byte;
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+void Chip8::SetQuirks(Quirks quirks) {
+    this->quirks = quirks;
+    addressMask = GetMemorySize(quirks) - 1;
+
+    // memory of the machine's own has to reach as far as the profile addresses; the image has what lies beyond
+    if (memory == ownMemory.get() && ownMemorySize < GetMemorySize(quirks)) {
+        std::unique_ptr<uint8_t[]> grown(new uint8_t[GetMemorySize(quirks)]);
+        std::copy(ownMemory.get(), ownMemory.get() + ownMemorySize, grown.get());
+        std::copy(image->memory + ownMemorySize, image->memory + GetMemorySize(quirks), grown.get() + ownMemorySize);
+        ownMemory = std::move(grown);
+        ownMemorySize = GetMemorySize(quirks);
+        memory = ownMemory.get();
+    }
 
-        // free buffer
-        delete[] buffer;
+    switch (quirks) {
+        case Quirks::Vip: handlers = opTable<Quirks::Vip>; break;
+        case Quirks::Chip48: handlers = opTable<Quirks::Chip48>; break;
+        case Quirks::Schip: handlers = opTable<Quirks::Schip>; break;
+        case Quirks::XoChip: handlers = opTable<Quirks::XoChip>; break;
+        default: handlers = opTable<Quirks::Modern>; break;
     }
 }
 
 void Chip8::Cycle() {
-    // Fetch
-    opcode = (memory[pc] << 8u) | memory[pc + 1];
+    // a parked Fx0A would only fail again
+    if (waitingForKey && GetKeys() == 0) {
+        return;
+    }
+
+    // Fetch the predecoded instruction; copied so a handler that overwrites its own code still sees its operands
+    Instruction instruction = Fetch(pc);
+    CHIP8_PROFILE_INSTRUCTION(instruction, pc);
+
+    // the raw opcode is only needed for the trace, and must be read before the instruction can overwrite itself
+    uint16_t address = pc;
+    uint16_t opcode = trace ? static_cast<uint16_t>((memory[pc & addressMask] << 8u) | memory[(pc + 1) & addressMask]) : 0;
 
     // Increment the PC before we execute anything
 	pc += 2;
 
-    // Decode and execute the opcode
-    ((*this).*(table[(opcode & 0xF000u) >> 12u]))();
+    // Execute the opcode, its operands were extracted once when it was decoded
+    ((*this).*(handlers[static_cast<size_t>(instruction.op)]))(instruction);
+    ++instructions;
+
+    if (trace) {
+        trace->Record(address, opcode, index, registers);
+    }
+}
+
+void Chip8::RunTraced(unsigned int cycles) {
+    switch (quirks) {
+        case Quirks::Vip: RunWith<Quirks::Vip, true>(cycles); break;
+        case Quirks::Chip48: RunWith<Quirks::Chip48, true>(cycles); break;
+        case Quirks::Schip: RunWith<Quirks::Schip, true>(cycles); break;
+        case Quirks::XoChip: RunWith<Quirks::XoChip, true>(cycles); break;
+        default: RunWith<Quirks::Modern, true>(cycles); break;
+    }
+}
 
+void Chip8::TickTimers() {
     // Decrement the delay timer if it's been set
     if (delayTimer > 0) {
         delayTimer--;
@@ -145,114 +520,809 @@ void Chip8::Cycle() {
     }
 }
 
-// clear the display
-void Chip8::OP_00E0() {
+void Chip8::RunFrame(unsigned int cyclesPerFrame) {
+    // one burst of instructions, then the single 60 Hz timer tick that ends the frame
+    Run(cyclesPerFrame);
+    TickTimers();
+}
+
+// Computed goto lets every handler jump straight to the next one instead of returning to a shared switch
+#if defined(__GNUC__) || defined(__clang__)
+#define CHIP8_COMPUTED_GOTO 1
+#endif
+
+void Chip8::Run(unsigned int cycles) {
+    if (trace) {
+        RunTraced(cycles);
+        return;
+    }
+
+    // pick the profile once per call; everything inside the loop is specialised for it
+    switch (quirks) {
+        case Quirks::Vip: RunWith<Quirks::Vip>(cycles); break;
+        case Quirks::Chip48: RunWith<Quirks::Chip48>(cycles); break;
+        case Quirks::Schip: RunWith<Quirks::Schip>(cycles); break;
+        case Quirks::XoChip: RunWith<Quirks::XoChip>(cycles); break;
+        default: RunWith<Quirks::Modern>(cycles); break;
+    }
+}
+
+template <Quirks Q, bool Traced>
+void Chip8::RunWith(unsigned int cycles) {
+    // nothing runs while an Fx0A is parked and no key is down
+    if (cycles == 0 || (waitingForKey && GetKeys() == 0)) {
+        return;
+    }
+
+    Instruction instruction;
+    // where the current instruction was fetched and its raw opcode, kept only for the trace
+    uint16_t address = 0;
+    uint16_t opcode = 0;
+    // loop head that already failed the idle check during this call, so it is not probed on every pass
+    uint16_t rejectedLoop = 0xFFFFu;
+    // the budget as given, and the part of it SkipIdleLoop() used up: passes it ran through Cycle(), which counts
+    // them itself, and passes it skipped, which never ran
+    unsigned int budget = cycles;
+    unsigned int idleCycles = 0;
+    // opcodes outside the profile's instruction set do what its opTable does with them
+    constexpr bool superChip = HasInstructionSet(Q, InstructionSet::SuperChip);
+    constexpr bool xoChip = HasInstructionSet(Q, InstructionSet::XoChip);
+
+    // the raw opcode has to be read before the instruction can overwrite itself
+#define CHIP8_FETCH() \
+    instruction = Fetch<Q>(pc); \
+    CHIP8_PROFILE_INSTRUCTION(instruction, pc); \
+    if constexpr (Traced) { \
+        address = pc; \
+        opcode = static_cast<uint16_t>((memory[pc & addressMask] << 8u) | memory[(pc + 1) & addressMask]); \
+    } \
+    pc += 2
+#define CHIP8_RECORD() \
+    if constexpr (Traced) { trace->Record(address, opcode, index, registers); }
+    // counts what this call executed itself; left is the budget still unused, the current instruction having run
+#define CHIP8_RETURN(left) { \
+        instructions += budget - (left) - idleCycles; \
+        return; \
+    }
+
+    // 1nnn at from: a short backward jump may close an idle loop, whose remaining passes can be skipped; not while
+    // tracing, where every pass has to be recorded. A pass is at least span / 2 + 1 instructions
+#define CHIP8_JUMP(from) { \
+        uint16_t span = static_cast<uint16_t>((from) - instruction.nnn); \
+        OP_1nnn(instruction); \
+        if (!Traced && span < IDLE_LOOP_BYTES && cycles > IDLE_LOOP_PROBE_PASSES * (span / 2u + 1u) && pc != rejectedLoop) { \
+            unsigned int idle = SkipIdleLoop(cycles - 1, rejectedLoop); \
+            cycles -= idle; \
+            idleCycles += idle; \
+        } \
+    }
+    // a fused skip then 1nnn: the jump runs in the same dispatch unless it was skipped or the budget is spent
+#define CHIP8_SKIP_JUMP(skip) { \
+        uint16_t jump = pc; \
+        skip(instruction); \
+        if (!Traced && pc == jump && cycles > 1) { \
+            --cycles; \
+            pc += 2; \
+            CHIP8_JUMP(jump); \
+        } \
+    }
+
+#ifdef CHIP8_COMPUTED_GOTO
+    // one label per Chip8::Op, in the same order
+    static void* const labels[static_cast<size_t>(Op::Count)] = {
+        &&L_OP_NULL, // Undecoded, never dispatched
+        &&L_OP_NULL,
+        &&L_OP_00E0,
+        &&L_OP_00EE,
+        &&L_OP_1nnn,
+        &&L_OP_2nnn,
+        &&L_OP_3xkk,
+        &&L_OP_4xkk,
+        &&L_OP_5xy0,
+        &&L_OP_6xkk,
+        &&L_OP_7xkk,
+        &&L_OP_8xy0,
+        &&L_OP_8xy1,
+        &&L_OP_8xy2,
+        &&L_OP_8xy3,
+        &&L_OP_8xy4,
+        &&L_OP_8xy5,
+        &&L_OP_8xy6,
+        &&L_OP_8xy7,
+        &&L_OP_8xyE,
+        &&L_OP_9xy0,
+        &&L_OP_Annn,
+        &&L_OP_Bnnn,
+        &&L_OP_Cxkk,
+        &&L_OP_Dxyn,
+        &&L_OP_Ex9E,
+        &&L_OP_ExA1,
+        &&L_OP_Fx07,
+        &&L_OP_Fx0A,
+        &&L_OP_Fx15,
+        &&L_OP_Fx18,
+        &&L_OP_Fx1E,
+        &&L_OP_Fx29,
+        &&L_OP_Fx33,
+        &&L_OP_Fx55,
+        &&L_OP_Fx65,
+        &&L_OP_00Cn,
+        &&L_OP_00Dn,
+        &&L_OP_00FB,
+        &&L_OP_00FC,
+        &&L_OP_00FD,
+        &&L_OP_00FE,
+        &&L_OP_00FF,
+        &&L_OP_5xy2,
+        &&L_OP_5xy3,
+        &&L_OP_F000,
+        &&L_OP_Fn01,
+        &&L_OP_F002,
+        &&L_OP_Fx30,
+        &&L_OP_Fx3A,
+        &&L_OP_Fx75,
+        &&L_OP_Fx85,
+        &&L_OP_3xkk_1nnn,
+        &&L_OP_4xkk_1nnn,
+        &&L_OP_5xy0_1nnn,
+        &&L_OP_9xy0_1nnn,
+        &&L_OP_Annn_Dxyn,
+        &&L_OP_6xkk_Fx29_Dxyn,
+        &&L_OP_Fx1E_Fx55_Fx1E,
+        &&L_OP_Fx1E_Fx65_Fx1E,
+    };
+
+    // after each handler: stop when the budget is spent, else fetch and jump to the next handler
+#define CHIP8_CASE(name) L_##name:
+#define CHIP8_NEXT() \
+    CHIP8_RECORD(); \
+    if (--cycles == 0) { CHIP8_RETURN(0); } \
+    CHIP8_FETCH(); \
+    goto *labels[static_cast<size_t>(instruction.op)]
+
+    CHIP8_FETCH();
+    goto *labels[static_cast<size_t>(instruction.op)];
+#else
+    // portable fallback: one flat switch over every opcode
+#define CHIP8_CASE(name) case Op::name:
+#define CHIP8_NEXT() CHIP8_RECORD(); break
+
+    for (; cycles > 0; --cycles) {
+        CHIP8_FETCH();
+
+        switch (instruction.op) {
+#endif
+
+    CHIP8_CASE(OP_NULL) OP_NULL(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_00E0) OP_00E0(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_00EE) OP_00EE(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_1nnn) CHIP8_JUMP(pc - 2); CHIP8_NEXT();
+    CHIP8_CASE(OP_2nnn) OP_2nnn(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_3xkk) OP_3xkk<Q>(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_4xkk) OP_4xkk<Q>(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_5xy0) OP_5xy0<Q>(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_6xkk) OP_6xkk(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_7xkk) OP_7xkk(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_8xy0) OP_8xy0(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_8xy1) OP_8xy1<Q>(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_8xy2) OP_8xy2<Q>(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_8xy3) OP_8xy3<Q>(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_8xy4) OP_8xy4(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_8xy5) OP_8xy5(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_8xy6) OP_8xy6<Q>(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_8xy7) OP_8xy7(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_8xyE) OP_8xyE<Q>(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_9xy0) OP_9xy0<Q>(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_Annn) OP_Annn(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_Bnnn) OP_Bnnn<Q>(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_Cxkk) OP_Cxkk(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_Dxyn) OP_Dxyn<Q>(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_Ex9E) OP_Ex9E<Q>(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_ExA1) OP_ExA1<Q>(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_Fx07) OP_Fx07(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_Fx0A) {
+        uint16_t next = pc;
+        OP_Fx0A(instruction);
+        // parked: the rest of the budget would change nothing until a key is pressed
+        if (pc != next) {
+            CHIP8_RECORD();
+            CHIP8_RETURN(cycles - 1);
+        }
+    } CHIP8_NEXT();
+    CHIP8_CASE(OP_Fx15) OP_Fx15(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_Fx18) OP_Fx18(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_Fx1E) OP_Fx1E(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_Fx29) OP_Fx29(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_Fx33) OP_Fx33<Q>(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_Fx55) OP_Fx55<Q>(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_Fx65) OP_Fx65<Q>(instruction); CHIP8_NEXT();
+    CHIP8_CASE(OP_00Cn) if constexpr (superChip) { OP_00Cn(instruction); } CHIP8_NEXT();
+    CHIP8_CASE(OP_00Dn) if constexpr (xoChip) { OP_00Dn(instruction); } CHIP8_NEXT();
+    CHIP8_CASE(OP_00FB) if constexpr (superChip) { OP_00FB(instruction); } CHIP8_NEXT();
+    CHIP8_CASE(OP_00FC) if constexpr (superChip) { OP_00FC(instruction); } CHIP8_NEXT();
+    CHIP8_CASE(OP_00FD) {
+        // the interpreter has exited and only spins on this instruction, so the rest of the budget would change nothing
+        if constexpr (superChip) {
+            OP_00FD(instruction);
+            CHIP8_RECORD();
+            CHIP8_RETURN(cycles - 1);
+        }
+    } CHIP8_NEXT();
+    CHIP8_CASE(OP_00FE) if constexpr (superChip) { OP_00FE(instruction); } CHIP8_NEXT();
+    CHIP8_CASE(OP_00FF) if constexpr (superChip) { OP_00FF(instruction); } CHIP8_NEXT();
+    CHIP8_CASE(OP_5xy2) if constexpr (xoChip) { OP_5xy2(instruction); } else { OP_5xy0<Q>(instruction); } CHIP8_NEXT();
+    CHIP8_CASE(OP_5xy3) if constexpr (xoChip) { OP_5xy3(instruction); } else { OP_5xy0<Q>(instruction); } CHIP8_NEXT();
+    CHIP8_CASE(OP_F000) if constexpr (xoChip) { OP_F000(instruction); } CHIP8_NEXT();
+    CHIP8_CASE(OP_Fn01) if constexpr (xoChip) { OP_Fn01(instruction); } CHIP8_NEXT();
+    CHIP8_CASE(OP_F002) if constexpr (xoChip) { OP_F002(instruction); } CHIP8_NEXT();
+    CHIP8_CASE(OP_Fx30) if constexpr (superChip) { OP_Fx30(instruction); } CHIP8_NEXT();
+    CHIP8_CASE(OP_Fx3A) if constexpr (xoChip) { OP_Fx3A(instruction); } CHIP8_NEXT();
+    CHIP8_CASE(OP_Fx75) if constexpr (superChip) { OP_Fx75(instruction); } CHIP8_NEXT();
+    CHIP8_CASE(OP_Fx85) if constexpr (superChip) { OP_Fx85(instruction); } CHIP8_NEXT();
+
+    // fused sequences run whole only while tracing is off and the budget covers them, otherwise just their first
+    // instruction, and the next dispatch picks up the rest from the cache one by one
+    CHIP8_CASE(OP_3xkk_1nnn) CHIP8_SKIP_JUMP(OP_3xkk<Q>); CHIP8_NEXT();
+    CHIP8_CASE(OP_4xkk_1nnn) CHIP8_SKIP_JUMP(OP_4xkk<Q>); CHIP8_NEXT();
+    CHIP8_CASE(OP_5xy0_1nnn) CHIP8_SKIP_JUMP(OP_5xy0<Q>); CHIP8_NEXT();
+    CHIP8_CASE(OP_9xy0_1nnn) CHIP8_SKIP_JUMP(OP_9xy0<Q>); CHIP8_NEXT();
+    CHIP8_CASE(OP_Annn_Dxyn) {
+        OP_Annn(instruction);
+        if (!Traced && cycles > 1) {
+            --cycles;
+            pc += 2;
+            OP_Dxyn<Q>(instruction);
+        }
+    } CHIP8_NEXT();
+    CHIP8_CASE(OP_6xkk_Fx29_Dxyn) {
+        OP_6xkk(instruction);
+        if (!Traced && cycles > 2) {
+            cycles -= 2;
+            pc += 4;
+            OP_Fx29(instruction);
+            Instruction draw;
+            draw.x = static_cast<uint8_t>(instruction.nnn >> 8u);
+            draw.y = static_cast<uint8_t>((instruction.nnn >> 4u) & 0xFu);
+            draw.n = static_cast<uint8_t>(instruction.nnn & 0xFu);
+            OP_Dxyn<Q>(draw);
+        }
+    } CHIP8_NEXT();
+    CHIP8_CASE(OP_Fx1E_Fx55_Fx1E) {
+        OP_Fx1E(instruction);
+        if (!Traced && cycles > 1) {
+            uint16_t head = static_cast<uint16_t>((pc - 2) & ADDRESS_MASK<Q>);
+            --cycles;
+            pc += 2;
+            Instruction store;
+            store.x = instruction.y;
+            OP_Fx55<Q>(store);
+            // a store over the sequence dropped it from the cache; the last Fx1E then runs from memory as it is now
+            if (cycles > 1 && decoded[head].op == Op::OP_Fx1E_Fx55_Fx1E) {
+                --cycles;
+                pc += 2;
+                Instruction add;
+                add.x = instruction.n;
+                OP_Fx1E(add);
+            }
+        }
+    } CHIP8_NEXT();
+    CHIP8_CASE(OP_Fx1E_Fx65_Fx1E) {
+        OP_Fx1E(instruction);
+        if (!Traced && cycles > 2) {
+            cycles -= 2;
+            pc += 4;
+            Instruction load;
+            load.x = instruction.y;
+            OP_Fx65<Q>(load);
+            Instruction add;
+            add.x = instruction.n;
+            OP_Fx1E(add);
+        }
+    } CHIP8_NEXT();
+
+#ifndef CHIP8_COMPUTED_GOTO
+            default:
+                break;
+        }
+    }
+    CHIP8_RETURN(0);
+#endif
+
+#undef CHIP8_FETCH
+#undef CHIP8_RECORD
+#undef CHIP8_RETURN
+#undef CHIP8_JUMP
+#undef CHIP8_SKIP_JUMP
+#undef CHIP8_CASE
+#undef CHIP8_NEXT
+}
+
+// true for instructions that touch nothing but the registers, I and pc, and read only what Run cannot change
+bool Chip8::IsIdleSafe(Op op) {
+    switch (op) {
+        case Op::OP_1nnn: case Op::OP_3xkk: case Op::OP_4xkk: case Op::OP_5xy0: case Op::OP_6xkk: case Op::OP_7xkk:
+        case Op::OP_8xy0: case Op::OP_8xy1: case Op::OP_8xy2: case Op::OP_8xy3: case Op::OP_8xy4: case Op::OP_8xy5:
+        case Op::OP_8xy6: case Op::OP_8xy7: case Op::OP_8xyE: case Op::OP_9xy0: case Op::OP_Annn: case Op::OP_Ex9E:
+        case Op::OP_ExA1: case Op::OP_Fx07: case Op::OP_Fx0A: case Op::OP_Fx1E: case Op::OP_Fx29: case Op::OP_Fx65:
+        // a fused sequence is stepped by Cycle() one instruction at a time, so only its first one counts
+        case Op::OP_3xkk_1nnn: case Op::OP_4xkk_1nnn: case Op::OP_5xy0_1nnn: case Op::OP_9xy0_1nnn:
+        case Op::OP_Annn_Dxyn: case Op::OP_6xkk_Fx29_Dxyn: case Op::OP_Fx1E_Fx55_Fx1E: case Op::OP_Fx1E_Fx65_Fx1E:
+            return true;
+        default:
+            return false;
+    }
+}
+
+Chip8::IdleAccess Chip8::GetIdleAccess(Instruction const& instruction) {
+    uint32_t Vx = 1u << instruction.x;
+    uint32_t Vy = 1u << instruction.y;
+    uint32_t VF = 1u << 0xFu;
+
+    // a fused sequence is stepped by Cycle() one instruction at a time, so only its first one counts
+    switch (instruction.op) {
+        case Op::OP_1nnn:
+            return {0, 0, 0};
+        case Op::OP_3xkk: case Op::OP_4xkk: case Op::OP_3xkk_1nnn: case Op::OP_4xkk_1nnn: case Op::OP_Ex9E:
+        case Op::OP_ExA1:
+            return {Vx, 0, 0};
+        case Op::OP_5xy0: case Op::OP_9xy0: case Op::OP_5xy0_1nnn: case Op::OP_9xy0_1nnn:
+            return {Vx | Vy, 0, 0};
+        case Op::OP_6xkk: case Op::OP_6xkk_Fx29_Dxyn: case Op::OP_Fx07:
+            return {0, Vx, Vx};
+        case Op::OP_7xkk:
+            return {Vx, Vx, Vx};
+        case Op::OP_8xy0:
+            return {Vy, Vx, Vx};
+        // VF is cleared only under some quirks
+        case Op::OP_8xy1: case Op::OP_8xy2: case Op::OP_8xy3:
+            return {Vx | Vy, Vx, Vx | VF};
+        // the shifts read Vx or Vy depending on the quirks
+        case Op::OP_8xy4: case Op::OP_8xy5: case Op::OP_8xy6: case Op::OP_8xy7: case Op::OP_8xyE:
+            return {Vx | Vy, Vx | VF, Vx | VF};
+        case Op::OP_Annn: case Op::OP_Annn_Dxyn:
+            return {0, IDLE_ACCESS_INDEX, IDLE_ACCESS_INDEX};
+        case Op::OP_Fx1E: case Op::OP_Fx1E_Fx55_Fx1E: case Op::OP_Fx1E_Fx65_Fx1E:
+            return {Vx | IDLE_ACCESS_INDEX, IDLE_ACCESS_INDEX, IDLE_ACCESS_INDEX};
+        case Op::OP_Fx29:
+            return {Vx, IDLE_ACCESS_INDEX, IDLE_ACCESS_INDEX};
+        // some quirks advance I
+        case Op::OP_Fx65:
+            return {IDLE_ACCESS_INDEX, (Vx << 1u) - 1u, ((Vx << 1u) - 1u) | IDLE_ACCESS_INDEX};
+        // Fx0A and anything else: assume it reads and may write everything
+        default:
+            return {0x1FFFFu, 0, 0x1FFFFu};
+    }
+}
+
+unsigned int Chip8::SkipIdleLoop(unsigned int remaining, uint16_t& rejectedLoop) {
+    uint16_t head = pc;
+    unsigned int executed = 0;
+
+    // the first pass may still be settling registers (e.g. Fx07 picking up the timer), so allow a second one
+    for (int pass = 0; pass < 2; ++pass) {
+        uint8_t before[16];
+        memcpy(before, registers, sizeof(registers));
+        uint16_t beforeIndex = index;
+        unsigned int length = 0;
+        // what the pass read before writing it itself, what it surely wrote so far and what it may have written
+        uint32_t exposed = 0;
+        uint32_t written = 0;
+        uint32_t mayWrite = 0;
+
+        // one pass, executed for real, giving up at anything with side effects or once it runs too long
+        do {
+            Instruction const& instruction = Fetch(pc);
+            if (executed == remaining || length == IDLE_LOOP_LENGTH || !IsIdleSafe(instruction.op)) {
+                rejectedLoop = head;
+                return executed;
+            }
+            IdleAccess access = GetIdleAccess(instruction);
+            exposed |= access.reads & ~written;
+            written |= access.writes;
+            mayWrite |= access.mayWrite;
+
+            Cycle();
+            ++executed;
+            ++length;
+        } while (pc != head);
+
+        // a pass that changed nothing will change nothing again until the timers or keypad do, which is after Run
+        // returns. Neither will one that never read a register or I before writing it: the next pass reads the same
+        // values, takes the same path and writes the same results. Skip whole passes and leave the leftover
+        // instructions to run normally
+        if ((exposed & mayWrite) == 0 || (memcmp(before, registers, sizeof(registers)) == 0 && index == beforeIndex)) {
+            return executed + (remaining - executed) / length * length;
+        }
+    }
+
+    rejectedLoop = head;
+    return executed;
+}
+
+// decode the opcode at address into a handler id and its operands
+Chip8::Instruction Chip8::Decode(uint16_t address) const {
+    return DecodeOpcode(static_cast<uint16_t>((memory[address] << 8u) | memory[(address + 1) & addressMask]));
+}
+
+Chip8::Instruction Chip8::DecodeOpcode(uint16_t opcode) {
+    Instruction instruction;
+    instruction.x = (opcode & 0x0F00u) >> 8u;
+    instruction.y = (opcode & 0x00F0u) >> 4u;
+    instruction.n = opcode & 0x000Fu;
+    instruction.kk = opcode & 0x00FFu;
+    instruction.nnn = opcode & 0x0FFFu;
+
+    // pick the handler on the first nibble, then on the last nibble or byte for the grouped opcodes
+    switch ((opcode & 0xF000u) >> 12u) {
+        case 0x0:
+            switch (opcode & 0xFFF0u) {
+                case 0x00C0: instruction.op = Op::OP_00Cn; break;
+                case 0x00D0: instruction.op = Op::OP_00Dn; break;
+                default:
+                    switch (opcode) {
+                        case 0x00E0: instruction.op = Op::OP_00E0; break;
+                        case 0x00EE: instruction.op = Op::OP_00EE; break;
+                        case 0x00FB: instruction.op = Op::OP_00FB; break;
+                        case 0x00FC: instruction.op = Op::OP_00FC; break;
+                        case 0x00FD: instruction.op = Op::OP_00FD; break;
+                        case 0x00FE: instruction.op = Op::OP_00FE; break;
+                        case 0x00FF: instruction.op = Op::OP_00FF; break;
+                        default: instruction.op = Op::OP_NULL; break;
+                    }
+                    break;
+            }
+            break;
+        case 0x1: instruction.op = Op::OP_1nnn; break;
+        case 0x2: instruction.op = Op::OP_2nnn; break;
+        case 0x3: instruction.op = Op::OP_3xkk; break;
+        case 0x4: instruction.op = Op::OP_4xkk; break;
+        case 0x5:
+            instruction.op = (instruction.n == 0x2u) ? Op::OP_5xy2 : (instruction.n == 0x3u) ? Op::OP_5xy3 : Op::OP_5xy0;
+            break;
+        case 0x6: instruction.op = Op::OP_6xkk; break;
+        case 0x7: instruction.op = Op::OP_7xkk; break;
+        case 0x8:
+            switch (instruction.n) {
+                case 0x0: instruction.op = Op::OP_8xy0; break;
+                case 0x1: instruction.op = Op::OP_8xy1; break;
+                case 0x2: instruction.op = Op::OP_8xy2; break;
+                case 0x3: instruction.op = Op::OP_8xy3; break;
+                case 0x4: instruction.op = Op::OP_8xy4; break;
+                case 0x5: instruction.op = Op::OP_8xy5; break;
+                case 0x6: instruction.op = Op::OP_8xy6; break;
+                case 0x7: instruction.op = Op::OP_8xy7; break;
+                case 0xE: instruction.op = Op::OP_8xyE; break;
+                default: instruction.op = Op::OP_NULL; break;
+            }
+            break;
+        case 0x9: instruction.op = Op::OP_9xy0; break;
+        case 0xA: instruction.op = Op::OP_Annn; break;
+        case 0xB: instruction.op = Op::OP_Bnnn; break;
+        case 0xC: instruction.op = Op::OP_Cxkk; break;
+        case 0xD: instruction.op = Op::OP_Dxyn; break;
+        case 0xE:
+            instruction.op = (instruction.kk == 0x9Eu) ? Op::OP_Ex9E : (instruction.kk == 0xA1u) ? Op::OP_ExA1 : Op::OP_NULL;
+            break;
+        case 0xF:
+            switch (instruction.kk) {
+                case 0x00: instruction.op = (instruction.x == 0) ? Op::OP_F000 : Op::OP_NULL; break;
+                case 0x01: instruction.op = Op::OP_Fn01; break;
+                case 0x02: instruction.op = (instruction.x == 0) ? Op::OP_F002 : Op::OP_NULL; break;
+                case 0x07: instruction.op = Op::OP_Fx07; break;
+                case 0x0A: instruction.op = Op::OP_Fx0A; break;
+                case 0x15: instruction.op = Op::OP_Fx15; break;
+                case 0x18: instruction.op = Op::OP_Fx18; break;
+                case 0x1E: instruction.op = Op::OP_Fx1E; break;
+                case 0x29: instruction.op = Op::OP_Fx29; break;
+                case 0x30: instruction.op = Op::OP_Fx30; break;
+                case 0x33: instruction.op = Op::OP_Fx33; break;
+                case 0x3A: instruction.op = Op::OP_Fx3A; break;
+                case 0x55: instruction.op = Op::OP_Fx55; break;
+                case 0x65: instruction.op = Op::OP_Fx65; break;
+                case 0x75: instruction.op = Op::OP_Fx75; break;
+                case 0x85: instruction.op = Op::OP_Fx85; break;
+                default: instruction.op = Op::OP_NULL; break;
+            }
+            break;
+    }
+
+    return instruction;
+}
+
+void Chip8::Fuse(uint8_t const* memory, uint16_t address, Instruction& instruction) {
+#ifndef CHIP8_PROFILE
+    // the rest of the sequence must be in the cache too, so a store to it can drop the whole sequence
+    if (address + FUSED_BYTES > MEMORY_SIZE) {
+        return;
+    }
+
+    uint16_t second = (memory[address + 2] << 8u) | memory[address + 3];
+    uint16_t third = (memory[address + 4] << 8u) | memory[address + 5];
+
+    switch (instruction.op) {
+        case Op::OP_3xkk:
+        case Op::OP_4xkk:
+        case Op::OP_5xy0:
+        case Op::OP_9xy0:
+            if ((second & 0xF000u) == 0x1000u) {
+                instruction.op = (instruction.op == Op::OP_3xkk) ? Op::OP_3xkk_1nnn
+                    : (instruction.op == Op::OP_4xkk) ? Op::OP_4xkk_1nnn
+                    : (instruction.op == Op::OP_5xy0) ? Op::OP_5xy0_1nnn : Op::OP_9xy0_1nnn;
+                instruction.nnn = second & 0x0FFFu;
+            }
+            break;
+        case Op::OP_Annn:
+            if ((second & 0xF000u) == 0xD000u) {
+                instruction.op = Op::OP_Annn_Dxyn;
+                instruction.x = (second & 0x0F00u) >> 8u;
+                instruction.y = (second & 0x00F0u) >> 4u;
+                instruction.n = second & 0x000Fu;
+            }
+            break;
+        case Op::OP_6xkk:
+            if (second == (0xF029u | (instruction.x << 8u)) && (third & 0xF000u) == 0xD000u) {
+                instruction.op = Op::OP_6xkk_Fx29_Dxyn;
+                instruction.nnn = third & 0x0FFFu;
+            }
+            break;
+        case Op::OP_Fx1E:
+            if (((second & 0xF0FFu) == 0xF055u || (second & 0xF0FFu) == 0xF065u) && (third & 0xF0FFu) == 0xF01Eu) {
+                instruction.op = ((second & 0xF0FFu) == 0xF055u) ? Op::OP_Fx1E_Fx55_Fx1E : Op::OP_Fx1E_Fx65_Fx1E;
+                instruction.y = (second & 0x0F00u) >> 8u;
+                instruction.n = (third & 0x0F00u) >> 8u;
+            }
+            break;
+        default:
+            break;
+    }
+#else
+    // the profiler counts instructions as they are dispatched, so it sees every one on its own
+    (void)memory;
+    (void)address;
+    (void)instruction;
+#endif
+}
+
+// unknown or unsupported opcode
+void Chip8::OP_NULL(Instruction const&) {}
+
+// clear the display (on XO-CHIP, only the selected planes)
+void Chip8::OP_00E0(Instruction const&) {
+    for (unsigned int plane = 0; plane < VIDEO_PLANES; ++plane) {
+        if ((planeMask >> plane) & 1u) {
+            memset(video[plane], 0, sizeof(video[plane]));
+        }
+    }
+
+    // every row has to be presented again
+    MarkAllRowsDirty();
+}
+
+// Scroll the selected planes down n rows; rows scrolled in at the top are blank
+void Chip8::OP_00Cn(Instruction const& instruction) {
+    unsigned int rows = instruction.n;
+    unsigned int height = GetVideoHeight();
+
+    for (unsigned int plane = 0; plane < VIDEO_PLANES; ++plane) {
+        if ((planeMask >> plane) & 1u) {
+            memmove(video[plane][rows], video[plane][0], (height - rows) * sizeof(video[plane][0]));
+            memset(video[plane][0], 0, rows * sizeof(video[plane][0]));
+        }
+    }
+
+    MarkAllRowsDirty();
+}
+
+// Scroll the selected planes up n rows; rows scrolled in at the bottom are blank
+void Chip8::OP_00Dn(Instruction const& instruction) {
+    unsigned int rows = instruction.n;
+    unsigned int height = GetVideoHeight();
+
+    for (unsigned int plane = 0; plane < VIDEO_PLANES; ++plane) {
+        if ((planeMask >> plane) & 1u) {
+            memmove(video[plane][0], video[plane][rows], (height - rows) * sizeof(video[plane][0]));
+            memset(video[plane][height - rows], 0, rows * sizeof(video[plane][0]));
+        }
+    }
+
+    MarkAllRowsDirty();
+}
+
+// Scroll the selected planes right 4 pixels; a row is one 128-bit shift spread over its two words
+void Chip8::OP_00FB(Instruction const&) {
+    // in low resolution the row ends with the first word, so whatever leaves it is gone
+    bool wide = hires;
+
+    for (unsigned int plane = 0; plane < VIDEO_PLANES; ++plane) {
+        if ((planeMask >> plane) & 1u) {
+            for (uint64_t* row : video[plane]) {
+                row[1] = wide ? (row[1] >> 4u) | (row[0] << 60u) : 0;
+                row[0] >>= 4u;
+            }
+        }
+    }
+
+    MarkAllRowsDirty();
+}
+
+// Scroll the selected planes left 4 pixels
+void Chip8::OP_00FC(Instruction const&) {
+    for (unsigned int plane = 0; plane < VIDEO_PLANES; ++plane) {
+        if ((planeMask >> plane) & 1u) {
+            for (uint64_t* row : video[plane]) {
+                row[0] = (row[0] << 4u) | (row[1] >> 60u);
+                row[1] <<= 4u;
+            }
+        }
+    }
+
+    MarkAllRowsDirty();
+}
+
+// Exit the interpreter: it stops on this instruction for good
+void Chip8::OP_00FD(Instruction const&) {
+    pc -= 2;
+}
+
+// Switch to 64x32; like Octo, changing resolution clears every plane
+void Chip8::OP_00FE(Instruction const&) {
+    hires = false;
+    memset(video, 0, sizeof(video));
+    MarkAllRowsDirty();
+}
+
+// Switch to 128x64
+void Chip8::OP_00FF(Instruction const&) {
+    hires = true;
     memset(video, 0, sizeof(video));
+    MarkAllRowsDirty();
 }
 
 // return from a subroutine
-void Chip8::OP_00EE() {
-    --sp;
+void Chip8::OP_00EE(Instruction const&) {
+    // the 16-entry stack wraps rather than reading outside the machine state
+    sp = (sp - 1) & 0xFu;
     pc = stack[sp];
 }
 
 // Jump to location nnn by using bitmask to extract address from last 12 bits of opcode
-void Chip8::OP_1nnn() {
-    uint16_t address = opcode & 0x0FFFu;
+void Chip8::OP_1nnn(Instruction const& instruction) {
+    uint16_t address = instruction.nnn;
     pc = address;
 }
 
 // call subroutine at nnn
-void Chip8::OP_2nnn() {
-    uint16_t address = opcode & 0x0FFFu;
+void Chip8::OP_2nnn(Instruction const& instruction) {
+    uint16_t address = instruction.nnn;
     
     stack[sp] = pc;
-    ++sp;
+    sp = (sp + 1) & 0xFu;
     pc = address;
 }
 
 // Skip instruction if Vx = kk
-void Chip8::OP_3xkk() {
-    uint8_t Vx = (opcode & 0x00F0u) >> 8u;
-    uint8_t kk = opcode & 0x00FFu;
+template <Quirks Q>
+void Chip8::OP_3xkk(Instruction const& instruction) {
+    uint8_t Vx = instruction.x;
+    uint8_t kk = instruction.kk;
 
     if (registers[Vx] == kk) {
-        pc += 2;
+        SkipNext<Q>();
     }
 }
 
 // Skip next instruction if Vx != kk
-void Chip8::OP_4xkk() {
-    uint8_t Vx = (opcode & 0x00F0u) >> 8u;
-    uint8_t kk = opcode & 0x00FFu;
+template <Quirks Q>
+void Chip8::OP_4xkk(Instruction const& instruction) {
+    uint8_t Vx = instruction.x;
+    uint8_t kk = instruction.kk;
 
     if (registers[Vx] != kk) {
-        pc += 2;
+        SkipNext<Q>();
     }
 }
 
 // Skip next instruction if Vx = Vy
-void Chip8::OP_5xy0() {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+template <Quirks Q>
+void Chip8::OP_5xy0(Instruction const& instruction) {
+    uint8_t Vx = instruction.x;
+    uint8_t Vy = instruction.y;
 
     if (registers[Vx] == registers[Vy]) {
-        pc += 2;
+        SkipNext<Q>();
+    }
+}
+
+// Store Vx through Vy (in either order) in memory starting at location I; I is not changed
+void Chip8::OP_5xy2(Instruction const& instruction) {
+    int step = instruction.x <= instruction.y ? 1 : -1;
+    unsigned int count = (step > 0 ? instruction.y - instruction.x : instruction.x - instruction.y) + 1;
+
+    uint8_t values[16];
+
+    for (unsigned int i = 0; i < count; ++i) {
+        values[i] = registers[instruction.x + step * static_cast<int>(i)];
+    }
+    WriteMemory<Quirks::XoChip>(index, values, count);
+}
+
+// Read Vx through Vy (in either order) from memory starting at location I; I is not changed
+void Chip8::OP_5xy3(Instruction const& instruction) {
+    int step = instruction.x <= instruction.y ? 1 : -1;
+    unsigned int count = (step > 0 ? instruction.y - instruction.x : instruction.x - instruction.y) + 1;
+
+    for (unsigned int i = 0; i < count; ++i) {
+        registers[instruction.x + step * static_cast<int>(i)] = memory[(index + i) & ADDRESS_MASK<Quirks::XoChip>];
     }
 }
 
 // Set Vx = kk
-void Chip8::OP_6xkk() {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t kk = opcode & 0x00FFu;
+void Chip8::OP_6xkk(Instruction const& instruction) {
+    uint8_t Vx = instruction.x;
+    uint8_t kk = instruction.kk;
 
     registers[Vx] = kk;
 }
 
 // Set Vx = Vx + kk
-void Chip8::OP_7xkk() {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t kk = opcode & 0x00FFu;
+void Chip8::OP_7xkk(Instruction const& instruction) {
+    uint8_t Vx = instruction.x;
+    uint8_t kk = instruction.kk;
 
     registers[Vx] += kk;
 }
 
 // Set Vx = Vy
-void Chip8::OP_8xy0() {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+void Chip8::OP_8xy0(Instruction const& instruction) {
+    uint8_t Vx = instruction.x;
+    uint8_t Vy = instruction.y;
 
     registers[Vx] = registers[Vy];
 }
 
 // Set Vx = Vx OR Vy
-void Chip8::OP_8xy1() {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+template <Quirks Q>
+void Chip8::OP_8xy1(Instruction const& instruction) {
+    uint8_t Vx = instruction.x;
+    uint8_t Vy = instruction.y;
 
     registers[Vx] |= registers[Vy];
+
+    if constexpr (QUIRK_FLAGS[static_cast<size_t>(Q)].logicResetsVF) {
+        registers[0xF] = 0;
+    }
 }
 
 // Set Vx = Vx AND Vy
-void Chip8::OP_8xy2() {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+template <Quirks Q>
+void Chip8::OP_8xy2(Instruction const& instruction) {
+    uint8_t Vx = instruction.x;
+    uint8_t Vy = instruction.y;
 
     registers[Vx] &= registers[Vy];
+
+    if constexpr (QUIRK_FLAGS[static_cast<size_t>(Q)].logicResetsVF) {
+        registers[0xF] = 0;
+    }
 }
 
 // Set Vx = Vx XOR Vy
-void Chip8::OP_8xy3() {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+template <Quirks Q>
+void Chip8::OP_8xy3(Instruction const& instruction) {
+    uint8_t Vx = instruction.x;
+    uint8_t Vy = instruction.y;
 
     registers[Vx] ^= registers[Vy];
+
+    if constexpr (QUIRK_FLAGS[static_cast<size_t>(Q)].logicResetsVF) {
+        registers[0xF] = 0;
+    }
 }
 
 // Set Vx = Vx + Vy, set VF = carry
-void Chip8::OP_8xy4() {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+void Chip8::OP_8xy4(Instruction const& instruction) {
+    uint8_t Vx = instruction.x;
+    uint8_t Vy = instruction.y;
 
     uint16_t sum = registers[Vx] + registers[Vy];
 
@@ -262,9 +1332,9 @@ void Chip8::OP_8xy4() {
 }
 
 // Set Vx = Vx - Vy, set VF = NOT BORROW
-void Chip8::OP_8xy5() {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+void Chip8::OP_8xy5(Instruction const& instruction) {
+    uint8_t Vx = instruction.x;
+    uint8_t Vy = instruction.y;
 
     registers[0xF] = registers[Vx] > registers[Vy];
 
@@ -272,19 +1342,27 @@ void Chip8::OP_8xy5() {
 }
 
 // Set Vx = Vx SHR 1
-void Chip8::OP_8xy6() {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-
-    // Save least significant bit in VF
-    registers[0xF] = registers[Vx] & 0x1u;
-
-    registers[Vx] >>= 1;
+template <Quirks Q>
+void Chip8::OP_8xy6(Instruction const& instruction) {
+    uint8_t Vx = instruction.x;
+
+    if constexpr (QUIRK_FLAGS[static_cast<size_t>(Q)].shiftUsesVy) {
+        // Vx = Vy >> 1, then the bit shifted out goes to VF
+        uint8_t source = registers[instruction.y];
+        registers[Vx] = source >> 1;
+        registers[0xF] = source & 0x1u;
+    } else {
+        // Save least significant bit in VF
+        registers[0xF] = registers[Vx] & 0x1u;
+
+        registers[Vx] >>= 1;
+    }
 }
 
 // Set Vx = Vy - Vx, set VF = NOT BORROW
-void Chip8::OP_8xy7() {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+void Chip8::OP_8xy7(Instruction const& instruction) {
+    uint8_t Vx = instruction.x;
+    uint8_t Vy = instruction.y;
 
     registers[0xF] = registers[Vy] > registers[Vx];
 
@@ -292,181 +1370,327 @@ void Chip8::OP_8xy7() {
 }
 
 // Set Vx = Vx SHL 1
-void Chip8::OP_8xyE() {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-
-    // Save most significant bit to VF
-    registers[0xF] = (registers[Vx] & 0x80u) >> 7u;
-
-    registers[Vx] <<= 1;
+template <Quirks Q>
+void Chip8::OP_8xyE(Instruction const& instruction) {
+    uint8_t Vx = instruction.x;
+
+    if constexpr (QUIRK_FLAGS[static_cast<size_t>(Q)].shiftUsesVy) {
+        // Vx = Vy << 1, then the bit shifted out goes to VF
+        uint8_t source = registers[instruction.y];
+        registers[Vx] = source << 1;
+        registers[0xF] = (source & 0x80u) >> 7u;
+    } else {
+        // Save most significant bit to VF
+        registers[0xF] = (registers[Vx] & 0x80u) >> 7u;
+
+        registers[Vx] <<= 1;
+    }
 }
 
 // Skip next instruction if Vx != Vy
-void Chip8::OP_9xy0() {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+template <Quirks Q>
+void Chip8::OP_9xy0(Instruction const& instruction) {
+    uint8_t Vx = instruction.x;
+    uint8_t Vy = instruction.y;
     
     if (registers[Vx] != registers[Vy]) {
-        pc += 2;
+        SkipNext<Q>();
     }
 }
 
 // Set I = nnn
-void Chip8::OP_Annn() {
-    uint8_t address = opcode & 0x0FFFu;
+void Chip8::OP_Annn(Instruction const& instruction) {
+    uint16_t address = instruction.nnn;
 
     index = address;
 }
 
 // Jump to location nnn + V0
-void Chip8::OP_Bnnn() {
-    uint8_t address = opcode & 0x0FFFu;
-
-    pc = registers[0] + address;
+template <Quirks Q>
+void Chip8::OP_Bnnn(Instruction const& instruction) {
+    uint16_t address = instruction.nnn;
+
+    // Bxnn variants add the register named by the address's top nibble instead of V0
+    if constexpr (QUIRK_FLAGS[static_cast<size_t>(Q)].jumpUsesVx) {
+        pc = registers[instruction.x] + address;
+    } else {
+        pc = registers[0] + address;
+    }
 }
 
 // Vx = random byte AND kk
-void Chip8::OP_Cxkk() {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t kk = opcode & 0x00FFu;
+void Chip8::OP_Cxkk(Instruction const& instruction) {
+    uint8_t Vx = instruction.x;
+    uint8_t kk = instruction.kk;
 
-    registers[Vx] = randByte(randGen) & kk;
+    registers[Vx] = RandomByte() & kk;
 }
 
-// Display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision
-void Chip8::OP_Dxyn() {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u;
-    uint8_t height = opcode & 0x000Fu;
+// Display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision.
+// With SUPER-CHIP, n = 0 draws a 16x16 sprite of two bytes per row; with XO-CHIP, each selected plane takes its own
+// sprite from consecutive memory
+template <Quirks Q>
+void Chip8::OP_Dxyn(Instruction const& instruction) {
+    CHIP8_PROFILE_SCOPE(Draw);
+
+    constexpr QuirkFlags flags = QUIRK_FLAGS[static_cast<size_t>(Q)];
+
+    uint8_t Vx = instruction.x;
+    uint8_t Vy = instruction.y;
+    unsigned int height = instruction.n;
+    unsigned int rowBytes = 1;
+    unsigned int screenWidth = VIDEO_WIDTH;
+    unsigned int screenHeight = VIDEO_HEIGHT;
+    unsigned int planes = 1;
+
+    if constexpr (HasInstructionSet(Q, InstructionSet::SuperChip)) {
+        if (height == 0) {
+            height = 16;
+            rowBytes = 2;
+        }
+        if (hires) {
+            screenWidth = HIRES_WIDTH;
+            screenHeight = HIRES_HEIGHT;
+        }
+    }
+    if constexpr (HasInstructionSet(Q, InstructionSet::XoChip)) {
+        planes = planeMask;
+    }
 
     // Wrap if going beyond screen boundaries
-    uint8_t xPos = registers[Vx] % VIDEO_WIDTH;
-    uint8_t yPos = registers[Vy] % VIDEO_HEIGHT;
-
-    registers[0xF] = 0;
-
-    for (unsigned int row = 0; row < height; ++row) {
-        uint8_t spriteByte = memory[index + row];
-        for (unsigned int column = 0; column < 8; ++column) {
-            uint8_t spritePixel = spriteByte & (0x80u >> column);
-            uint32_t* screenPixel = &video[(yPos + row) * VIDEO_WIDTH + (xPos + column)];
-
-            // Sprite pixel is on
-            if (spritePixel) {
-                // If Screen pixel is also on - collision
-                if (*screenPixel == 0xFFFFFFFF) {
-                    registers[0xF] = 1;
+    unsigned int xPos = registers[Vx] % screenWidth;
+    unsigned int yPos = registers[Vy] % screenHeight;
+
+    uint64_t collision = 0;
+    uint16_t address = index;
+
+    for (unsigned int plane = 0; plane < VIDEO_PLANES; ++plane) {
+        if (!((planes >> plane) & 1u)) {
+            continue;
+        }
+
+        for (unsigned int row = 0; row < height; ++row) {
+            // the sprite row, left-aligned in a word: 8 or 16 pixels
+            uint64_t sprite = static_cast<uint64_t>(memory[(address + row * rowBytes) & ADDRESS_MASK<Q>]) << 56u;
+            if (rowBytes == 2) {
+                sprite |= static_cast<uint64_t>(memory[(address + row * 2 + 1) & ADDRESS_MASK<Q>]) << 48u;
+            }
+
+            unsigned int y;
+            if constexpr (flags.spritesWrap) {
+                // rows past the bottom continue at the top
+                y = (yPos + row) % screenHeight;
+            } else {
+                // clip rows that fall off the bottom of the screen
+                if (yPos + row >= screenHeight) {
+                    break;
+                }
+                y = yPos + row;
+            }
+
+            // line the sprite up with column xPos across the row's words; pixels past the right edge are shifted
+            // out (clipped) or, where the profile wraps, rotated round to the left
+            uint64_t left;
+            uint64_t right = 0;
+            if (screenWidth == VIDEO_WIDTH) {
+                left = sprite >> xPos;
+                if constexpr (flags.spritesWrap) {
+                    left |= xPos ? sprite << (VIDEO_WIDTH - xPos) : 0;
+                }
+            } else if (xPos < 64) {
+                left = sprite >> xPos;
+                right = xPos ? sprite << (64 - xPos) : 0;
+            } else {
+                left = 0;
+                right = sprite >> (xPos - 64);
+                if constexpr (flags.spritesWrap) {
+                    left = xPos > 64 ? sprite << (HIRES_WIDTH - xPos) : 0;
                 }
-                // effectively XOR with the sprite pixel
-                *screenPixel ^= 0xFFFFFFFF;
             }
+
+            uint64_t* screenRow = video[plane][y];
+
+            // any lit screen pixel under a lit sprite pixel is a collision, then XOR the sprite in
+            collision |= (screenRow[0] & left) | (screenRow[1] & right);
+            screenRow[0] ^= left;
+            screenRow[1] ^= right;
+            dirtyRows |= 1ull << y;
         }
+
+        // the next plane's sprite follows this one
+        address += height * rowBytes;
     }
+
+    registers[0xF] = collision != 0;
 }
 
 // Skip next instruction if key with the value of Vx is pressed
-void Chip8::OP_Ex9E() {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+template <Quirks Q>
+void Chip8::OP_Ex9E(Instruction const& instruction) {
+    uint8_t Vx = instruction.x;
     
-    uint8_t key = registers[Vx];
+    uint8_t key = registers[Vx] & 0xFu;
 
-    if (keypad[key]) {
-        pc += 2;
+    if (GetKeys() & (1u << key)) {
+        SkipNext<Q>();
     }
 }
 
 // Skip next instruction if key with the value of Vx is not pressed
-void Chip8::OP_ExA1() {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+template <Quirks Q>
+void Chip8::OP_ExA1(Instruction const& instruction) {
+    uint8_t Vx = instruction.x;
     
-    uint8_t key = registers[Vx];
+    uint8_t key = registers[Vx] & 0xFu;
 
-    if (!keypad[key]) {
-        pc += 2;
+    if (!(GetKeys() & (1u << key))) {
+        SkipNext<Q>();
     }
 }
 
 // Set Vx = delay timer value
-void Chip8::OP_Fx07() {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+void Chip8::OP_Fx07(Instruction const& instruction) {
+    uint8_t Vx = instruction.x;
 
     registers[Vx] = delayTimer;
 }
 
-// Wait for key press, store the value of the key in Vx
-void Chip8::OP_Fx0A() {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+// Set I = the 16-bit address in the following word, which is read here rather than decoded so that
+// the decode cache never depends on it
+void Chip8::OP_F000(Instruction const&) {
+    index = (memory[pc & ADDRESS_MASK<Quirks::XoChip>] << 8u) | memory[(pc + 1) & ADDRESS_MASK<Quirks::XoChip>];
+    pc += 2;
+}
 
-    for (uint8_t i = 0; i < 16; ++i)
-	{
-		if (keypad[i])
-		{
-			registers[Vx] = i;
-			return;
-		}
-	}
+// Select the planes (bit n = plane n) that drawing, clearing and scrolling affect
+void Chip8::OP_Fn01(Instruction const& instruction) {
+    planeMask = instruction.x & ((1u << VIDEO_PLANES) - 1);
+}
+
+// Load the 16-byte audio pattern from memory starting at location I
+void Chip8::OP_F002(Instruction const&) {
+    for (unsigned int i = 0; i < sizeof(audioPattern); ++i) {
+        audioPattern[i] = memory[(index + i) & ADDRESS_MASK<Quirks::XoChip>];
+    }
+}
 
-	pc -= 2;  // No key was pressed, repeat the instruction
+// Wait for key press, store the value of the key in Vx
+void Chip8::OP_Fx0A(Instruction const& instruction) {
+    uint8_t Vx = instruction.x;
+
+    uint16_t keys = GetKeys();
+    if (keys == 0) {
+        // No key was pressed: park on this instruction until one is
+        pc -= 2;
+        waitingForKey = true;
+        return;
+    }
+
+    // the lowest numbered key held
+    uint8_t key = 0;
+    while (!(keys & 1u)) {
+        keys >>= 1u;
+        ++key;
+    }
+    registers[Vx] = key;
+    waitingForKey = false;
 }
 
 // Set delay timer = Vx
-void Chip8::OP_Fx15() {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+void Chip8::OP_Fx15(Instruction const& instruction) {
+    uint8_t Vx = instruction.x;
 
     delayTimer = registers[Vx];
 }
 
 // Set sound timer = Vx
-void Chip8::OP_Fx18() {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+void Chip8::OP_Fx18(Instruction const& instruction) {
+    uint8_t Vx = instruction.x;
 
     soundTimer = registers[Vx];
 }
 
 // Set I = I + Vx
-void Chip8::OP_Fx1E() {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+void Chip8::OP_Fx1E(Instruction const& instruction) {
+    uint8_t Vx = instruction.x;
 
     index += registers[Vx];
 }
 
 // Set I = location of sprite for digit Vx
-void Chip8::OP_Fx29() {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+void Chip8::OP_Fx29(Instruction const& instruction) {
+    uint8_t Vx = instruction.x;
     uint8_t digit = registers[Vx];
 
     index = FONTSET_START_ADDRESS + (5 * digit);
 }
 
+// Set I = location of the large sprite for digit Vx
+void Chip8::OP_Fx30(Instruction const& instruction) {
+    uint8_t Vx = instruction.x;
+    uint8_t digit = registers[Vx] & 0xFu;
+
+    index = BIG_FONTSET_START_ADDRESS + (10 * digit);
+}
+
+// Set the audio pattern playback pitch = Vx
+void Chip8::OP_Fx3A(Instruction const& instruction) {
+    uint8_t Vx = instruction.x;
+
+    pitch = registers[Vx];
+}
+
 // Store BCD representation of Vx in memory locations I, I+1, and I+2
-void Chip8::OP_Fx33() {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+template <Quirks Q>
+void Chip8::OP_Fx33(Instruction const& instruction) {
+    uint8_t Vx = instruction.x;
     uint8_t value = registers[Vx];
+    uint8_t digits[3];
 
     // Ones-place
-    memory[index + 2] = value % 10;
+    digits[2] = value % 10;
     value /= 10;
     // Tens-place
-    memory[index + 1] = value % 10;
+    digits[1] = value % 10;
     value /= 10;
     // Hundreds-place
-    memory[index] = value % 10;
+    digits[0] = value % 10;
+
+    WriteMemory<Q>(index, digits, 3);
 }
 
 // Store registers V0 through Vx in memory starting at location I
-void Chip8::OP_Fx55() {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+template <Quirks Q>
+void Chip8::OP_Fx55(Instruction const& instruction) {
+    uint8_t Vx = instruction.x;
 
-    for (uint8_t i = 0; i <= Vx; ++i) {
-        memory[index + i] = registers[i];
-    }
+    WriteMemory<Q>(index, registers, Vx + 1u);
+
+    AdvanceIndex<Q>(Vx);
 }
 
 // Read registers V0 through Vx from memory starting at location I
-void Chip8::OP_Fx65() {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+template <Quirks Q>
+void Chip8::OP_Fx65(Instruction const& instruction) {
+    uint8_t Vx = instruction.x;
 
     for (uint8_t i = 0; i <= Vx; ++i) {
-        registers[i] = memory[index + i];
+        registers[i] = memory[(index + i) & ADDRESS_MASK<Q>];
     } 
+
+    AdvanceIndex<Q>(Vx);
+}
+
+// Store registers V0 through Vx in the user flags
+void Chip8::OP_Fx75(Instruction const& instruction) {
+    uint8_t Vx = instruction.x;
+
+    memcpy(userFlags, registers, Vx + 1u);
+}
+
+// Read registers V0 through Vx from the user flags
+void Chip8::OP_Fx85(Instruction const& instruction) {
+    uint8_t Vx = instruction.x;
+
+    memcpy(registers, userFlags, Vx + 1u);
 }
\ No newline at end of file
@@ -1,113 +1,525 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
-#include <random>
+#include <memory>
 
 const unsigned int VIDEO_HEIGHT = 32;
 const unsigned int VIDEO_WIDTH = 64;
+// SUPER-CHIP/XO-CHIP high-resolution mode
+const unsigned int HIRES_HEIGHT = 64;
+const unsigned int HIRES_WIDTH = 128;
+// XO-CHIP draws on two bitplanes; the other variants only ever use the first
+const unsigned int VIDEO_PLANES = 2;
+// 64-bit words per framebuffer row, enough for a high-resolution row
+const unsigned int VIDEO_ROW_WORDS = HIRES_WIDTH / 64;
+const unsigned int MEMORY_SIZE = 4096;
+// XO-CHIP address space; the other variants only see the first MEMORY_SIZE bytes
+const unsigned int XO_MEMORY_SIZE = 65536;
+// The 4x5 hex digit sprites that Fx29 points I at
+const unsigned int FONTSET_START_ADDRESS = 0x50;
+// The delay and sound timers count down at this rate, once per frame
+const unsigned int FRAMES_PER_SECOND = 60;
+// Instructions per frame when the caller does not choose (about 600 instructions/sec)
+const unsigned int DEFAULT_CYCLES_PER_FRAME = 10;
+
+// Interpreter families whose behaviour differs on a handful of opcodes; Modern is the default
+enum class Quirks : uint8_t {
+    Vip,
+    Chip48,
+    Schip,
+    Modern,
+    XoChip,
+    Count
+};
+
+// Opcodes a profile understands beyond the original set; each one includes the previous
+enum class InstructionSet : uint8_t {
+    Chip8,
+    // 00Cn/00FB/00FC scrolls, 00FD exit, 00FE/00FF resolution, 16x16 Dxy0 sprites, Fx30 large font, Fx75/Fx85 flags
+    SuperChip,
+    // 00Dn scroll up, 5xy2/5xy3 register ranges, F000 nnnn long I, Fn01 planes, F002/Fx3A audio, 64 KB of memory
+    XoChip
+};
+
+// How far Fx55/Fx65 move I after the transfer
+enum class IndexIncrement : uint8_t {
+    None,
+    X,
+    XPlusOne
+};
+
+// What a profile does at each point where the variants disagree
+struct QuirkFlags {
+    // 8xy1/8xy2/8xy3 clear VF
+    bool logicResetsVF;
+    // 8xy6/8xyE shift Vy into Vx instead of shifting Vx in place
+    bool shiftUsesVy;
+    IndexIncrement loadStoreIncrement;
+    // Bxnn jumps to xnn + Vx instead of nnn + V0
+    bool jumpUsesVx;
+    // sprites crossing an edge wrap around to the other side instead of being clipped
+    bool spritesWrap;
+    InstructionSet instructionSet;
+};
+
+// Indexed by Quirks
+constexpr QuirkFlags QUIRK_FLAGS[static_cast<size_t>(Quirks::Count)] = {
+    {true, true, IndexIncrement::XPlusOne, false, false, InstructionSet::Chip8},     // COSMAC VIP
+    {false, false, IndexIncrement::X, true, false, InstructionSet::Chip8},          // CHIP-48
+    {false, false, IndexIncrement::None, true, false, InstructionSet::SuperChip},   // SUPER-CHIP 1.1
+    {false, false, IndexIncrement::None, false, false, InstructionSet::Chip8},      // modern
+    {false, true, IndexIncrement::XPlusOne, false, true, InstructionSet::XoChip},   // XO-CHIP
+};
+
+// True if the profile runs the opcodes of set (and of every set before it)
+constexpr bool HasInstructionSet(Quirks quirks, InstructionSet set) {
+    return QUIRK_FLAGS[static_cast<size_t>(quirks)].instructionSet >= set;
+}
+
+// Bytes of memory the profile can address
+constexpr unsigned int GetMemorySize(Quirks quirks) {
+    return HasInstructionSet(quirks, InstructionSet::XoChip) ? XO_MEMORY_SIZE : MEMORY_SIZE;
+}
+
+// Converts between profiles and their command-line names ("vip", "chip48", "schip", "modern", "xochip")
+bool ParseQuirks(char const* name, Quirks& quirks);
+char const* GetQuirksName(Quirks quirks);
+
+class TraceWriter;
 
 class Chip8 {
+    // the recompiler reads and writes the machine state directly from generated code
+    friend class Jit;
+    // the profiler reads decoded instructions to count them by opcode
+    friend class Profiler;
+    // the batch engine copies a machine into its lanes and back, and shares the decoder
+    friend class Batch;
+
 public:
     Chip8();
-	void LoadROM(char const* filename);
+    // Seeds the RNG explicitly so instances created at the same instant do not share a sequence
+    explicit Chip8(unsigned int seed);
+	bool LoadROM(char const* filename);
+    // Loads a ROM image already in memory, e.g. one built by a benchmark or embedded in the program
+    bool LoadROM(uint8_t const* data, size_t size);
+    // Memory as a freshly loaded ROM leaves it (fonts, then the ROM at 0x200) and its decoding, built once and shared
+    // by every machine that loads it. A machine reads its image until its first store gives it memory of its own
+    struct Image;
+    // Null if the ROM does not fit even in XO-CHIP memory, or the file cannot be read
+    static std::shared_ptr<Image const> MakeImage(uint8_t const* data, size_t size);
+    static std::shared_ptr<Image const> MakeImage(char const* filename);
+    // Loads an image several machines can share; returns false if the ROM does not fit the profile's memory
+    bool LoadROM(std::shared_ptr<Image const> image);
+    // Executes one instruction; timers are not touched, see TickTimers()
     void Cycle();
+    // Runs cycles instructions back to back without returning; same behaviour as calling Cycle() that many times
+    void Run(unsigned int cycles);
+    // Decrements the delay and sound timers; call once per 60 Hz frame, independent of the instruction rate
+    void TickTimers();
+    // Runs one frame: cyclesPerFrame instructions followed by one timer tick
+    void RunFrame(unsigned int cyclesPerFrame);
+    // Instructions executed since the machine was created, by Run(), Cycle() or the recompiler. Idle-loop passes that
+    // Run() skips and the budget it leaves unused while an Fx0A is parked or after 00FD are not counted
+    unsigned long long GetInstructions() const { return instructions; }
 
-    uint8_t keypad[16]{};
-    uint32_t video[64 * 32]{};
+    // Read-only views of the CPU state, used by the headless runner to dump the final state
+    uint8_t const* GetRegisters() const { return registers; }
+    uint16_t GetIndex() const { return index; }
+    uint16_t GetPC() const { return pc; }
+    uint8_t GetSP() const { return sp; }
+    uint8_t GetDelayTimer() const { return delayTimer; }
+    uint8_t GetSoundTimer() const { return soundTimer; }
+
+    // Current resolution: 64x32, or 128x64 after a SUPER-CHIP 00FF
+    bool IsHires() const { return hires; }
+    unsigned int GetVideoWidth() const { return hires ? HIRES_WIDTH : VIDEO_WIDTH; }
+    unsigned int GetVideoHeight() const { return hires ? HIRES_HEIGHT : VIDEO_HEIGHT; }
+    // XO-CHIP sound: a 128-bit 1-bit sample pattern (F002) played back at a rate set by the pitch register (Fx3A)
+    uint8_t const* GetAudioPattern() const { return audioPattern; }
+    uint8_t GetPitch() const { return pitch; }
+
+    // Records every instruction executed from now on into trace, or stops recording if it is null. While tracing,
+    // idle loops are executed rather than skipped
+    void SetTrace(TraceWriter* trace) { this->trace = trace; }
+
+    // Chooses the behaviour of the opcodes the variants disagree on; takes effect from the next instruction
+    void SetQuirks(Quirks quirks);
+    Quirks GetQuirks() const { return quirks; }
+
+    // Size of a snapshot: header and quirks, registers, index, pc, stack, sp, timers, RNG, display mode, planes,
+    // pitch, flags, audio pattern, video and then as much memory as the profile can address
+    static constexpr size_t GetStateSize(Quirks quirks) {
+        return 7 + 16 + 2 + 2 + 16 * 2 + 3 + 4 + 3 + 16 + 16 + VIDEO_PLANES * HIRES_HEIGHT * VIDEO_ROW_WORDS * 8
+            + GetMemorySize(quirks);
+    }
+    size_t GetStateSize() const { return GetStateSize(quirks); }
+
+    // Writes a versioned snapshot of the whole machine (except the keypad) into GetStateSize() bytes
+    void SaveState(uint8_t* buffer) const;
+    // Restores a snapshot; returns false and leaves the machine untouched if it is not a valid one
+    bool LoadState(uint8_t const* buffer, size_t size);
+    bool SaveStateFile(char const* filename) const;
+    bool LoadStateFile(char const* filename);
+    // Hash of the same state a snapshot holds; two runs that end identically give the same value
+    uint64_t Checksum() const;
+
+    // Bytes this machine takes on its own: the object, plus memory and a decode cache once it has stored to memory.
+    // Its image is not counted, being shared
+    size_t GetFootprint() const;
+    static size_t GetImageFootprint();
+
+    // Returns a bit per video row (bit n = row n) changed since the last call, and clears it
+    uint64_t TakeDirtyRows() {
+        uint64_t rows = dirtyRows;
+        dirtyRows = 0;
+        return rows;
+    }
+
+    // The keypad as a mask, bit n = key n. Safe to call from any thread, though a change made while Run() executes
+    // may not be seen before it returns; frontends that record input set it between frames
+    void SetKeys(uint16_t keys) { keypad.store(keys, std::memory_order_relaxed); }
+    void PressKey(unsigned int key) { keypad.fetch_or(static_cast<uint16_t>(1u << key), std::memory_order_relaxed); }
+    void ReleaseKey(unsigned int key) { keypad.fetch_and(static_cast<uint16_t>(~(1u << key)), std::memory_order_relaxed); }
+    uint16_t GetKeys() const { return keypad.load(std::memory_order_relaxed); }
+    // True while an Fx0A is parked waiting for a key press; until then Run() and Cycle() return without executing
+    bool IsWaitingForKey() const { return waitingForKey; }
+
+    // Per plane, one row of VIDEO_ROW_WORDS 64-bit words per pixel row, most significant bit of the first word is
+    // the leftmost pixel. Only the top-left GetVideoWidth() x GetVideoHeight() pixels are in use
+    uint64_t video[VIDEO_PLANES][HIRES_HEIGHT][VIDEO_ROW_WORDS]{};
 
 private:
-    void Table0();
-	void Table8();
-	void TableE();
-	void TableF();
+    // Handler ids produced by the decoder; Undecoded marks a cache slot that must be decoded again.
+    // The fused ids after OP_Fx85 stand for a whole sequence starting at their address, see Fuse()
+    enum class Op : uint8_t {
+        Undecoded,
+        OP_NULL,
+        OP_00E0, OP_00EE, OP_1nnn, OP_2nnn, OP_3xkk, OP_4xkk, OP_5xy0, OP_6xkk, OP_7xkk,
+        OP_8xy0, OP_8xy1, OP_8xy2, OP_8xy3, OP_8xy4, OP_8xy5, OP_8xy6, OP_8xy7, OP_8xyE,
+        OP_9xy0, OP_Annn, OP_Bnnn, OP_Cxkk, OP_Dxyn, OP_Ex9E, OP_ExA1,
+        OP_Fx07, OP_Fx0A, OP_Fx15, OP_Fx18, OP_Fx1E, OP_Fx29, OP_Fx33, OP_Fx55, OP_Fx65,
+        OP_00Cn, OP_00Dn, OP_00FB, OP_00FC, OP_00FD, OP_00FE, OP_00FF, OP_5xy2, OP_5xy3,
+        OP_F000, OP_Fn01, OP_F002, OP_Fx30, OP_Fx3A, OP_Fx75, OP_Fx85,
+        OP_3xkk_1nnn, OP_4xkk_1nnn, OP_5xy0_1nnn, OP_9xy0_1nnn, OP_Annn_Dxyn, OP_6xkk_Fx29_Dxyn,
+        OP_Fx1E_Fx55_Fx1E, OP_Fx1E_Fx65_Fx1E,
+        Count
+    };
+
+    // Longest fused sequence in bytes; a store can change the sequences starting up to this far before it
+    static constexpr unsigned int FUSED_BYTES = 6;
+
+    // A decoded opcode: which handler runs it, plus every operand already masked and shifted out.
+    // A fused sequence keeps the operands of its first instruction where that instruction's handler reads them,
+    // and packs the rest into the fields it does not use
+    struct Instruction {
+        Op op{};
+        uint8_t x{};
+        uint8_t y{};
+        uint8_t n{};
+        uint8_t kk{};
+        uint16_t nnn{};
+    };
+
+    Instruction Decode(uint16_t address) const;
+    // Decode() of an opcode already read from memory
+    static Instruction DecodeOpcode(uint16_t opcode);
+    // Turns a freshly decoded instruction into a fused sequence if it starts one that lies wholly in the cache:
+    //   3xkk/4xkk/5xy0/9xy0 then 1nnn: the skip's operands, nnn = jump target
+    //   Annn then Dxyn: nnn = I, x/y/n = the draw's
+    //   6xkk then Fx29 on the same Vx then Dxyn: x/kk = the load's, nnn = the draw's xyn
+    //   Fx1E then Fx55/Fx65 then Fx1E: x, y and n = the three instructions' Vx
+    // Only the first instruction's handler runs when a sequence is stepped by Cycle() or cut short by the budget;
+    // a jump into the middle finds the instructions there decoded on their own
+    static void Fuse(uint8_t const* memory, uint16_t address, Instruction& instruction);
+
+    // Run() for one quirk profile, so none of its handlers test a quirk at run time
+    template <Quirks Q, bool Traced = false>
+    void RunWith(unsigned int cycles);
+    // Run() while a trace is being recorded
+    void RunTraced(unsigned int cycles);
+
+    // Idle-loop fast-forward for Run(): with pc at the head of a loop, runs passes until one leaves the machine
+    // unchanged, or only reads registers it wrote first, then accounts for every further whole pass that fits in
+    // remaining without running it. Returns the instructions run or skipped; a loop that is not idle is recorded in
+    // rejectedLoop
+    static bool IsIdleSafe(Op op);
+    // Which of V0-VF (bits 0-15) and I (bit 16) an idle-safe instruction reads, always writes and may write
+    struct IdleAccess {
+        uint32_t reads;
+        uint32_t writes;
+        uint32_t mayWrite;
+    };
+    static IdleAccess GetIdleAccess(Instruction const& instruction);
+    unsigned int SkipIdleLoop(unsigned int remaining, uint16_t& rejectedLoop);
+
+    // GetMemorySize(Q) - 1 as a constant, for code specialised for one profile
+    template <Quirks Q>
+    static constexpr uint16_t ADDRESS_MASK = GetMemorySize(Q) - 1;
+
+    // Returns the cached decoding of the instruction at address, decoding it on first use.
+    // Only the first MEMORY_SIZE bytes are cached; code above that (XO-CHIP only) is decoded every time
+    template <Quirks Q>
+    Instruction const& Fetch(uint16_t address) {
+        address &= ADDRESS_MASK<Q>;
+        if constexpr (HasInstructionSet(Q, InstructionSet::XoChip)) {
+            if (address >= MEMORY_SIZE) {
+                uncached = Decode(address);
+                return uncached;
+            }
+        }
+
+        Instruction const& cached = decoded[address];
+        if (cached.op == Op::Undecoded) {
+            return DecodeCached(address);
+        }
+        return cached;
+    }
+
+    // Fetch() of an address not decoded yet, which is decoded into the machine's own cache. An image leaves only its
+    // last address undecoded, as the second byte there depends on the profile
+    Instruction const& DecodeCached(uint16_t address);
+
+    // Fetch() for code not specialised for a profile
+    Instruction const& Fetch(uint16_t address) {
+        return quirks == Quirks::XoChip ? Fetch<Quirks::XoChip>(address) : Fetch<Quirks::Modern>(address);
+    }
+
+    // Stores count bytes from data starting at address, wrapping at the end of memory, into memory of the machine's
+    // own (copied from the image on the first store), and drops the cached decodings
+    // of every instruction or fused sequence that can overlap them (F000 nnnn reads its second word when it runs, so
+    // that word never ends up in the cache)
+    template <Quirks Q>
+    void WriteMemory(uint16_t address, uint8_t const* data, unsigned int count) {
+        Unshare();
+        for (unsigned int i = 0; i < count; ++i) {
+            ownMemory[(address + i) & ADDRESS_MASK<Q>] = data[i];
+        }
+        for (unsigned int i = 0; i < count + FUSED_BYTES - 1; ++i) {
+            ownDecoded[(address - (FUSED_BYTES - 1) + i) & (MEMORY_SIZE - 1)].op = Op::Undecoded;
+        }
+    }
+
+    // Gives the machine memory and a decode cache of its own, copied from its image, if it is still reading that
+    void Unshare() {
+        if (memory != ownMemory.get()) {
+            CopyImage();
+        }
+    }
+    void CopyImage();
+    // Allocates ownMemory and ownDecoded, unless they already exist and are large enough for the profile
+    void ReserveOwnMemory();
+
+    // Skips the next instruction, which on XO-CHIP may be the four-byte F000 nnnn
+    template <Quirks Q>
+    void SkipNext() {
+        if constexpr (HasInstructionSet(Q, InstructionSet::XoChip)) {
+            if (memory[pc & ADDRESS_MASK<Q>] == 0xF0u && memory[(pc + 1) & ADDRESS_MASK<Q>] == 0x00u) {
+                pc += 2;
+            }
+        }
+        pc += 2;
+    }
+
+    // Marks every row of the current resolution for presenting again
+    void MarkAllRowsDirty() {
+        dirtyRows = ~0ull >> (64u - GetVideoHeight());
+    }
+
+    // Moves I past the registers Fx55/Fx65 transferred, as far as the profile says
+    template <Quirks Q>
+    void AdvanceIndex(uint8_t Vx) {
+        if constexpr (QUIRK_FLAGS[static_cast<size_t>(Q)].loadStoreIncrement == IndexIncrement::X) {
+            index += Vx;
+        } else if constexpr (QUIRK_FLAGS[static_cast<size_t>(Q)].loadStoreIncrement == IndexIncrement::XPlusOne) {
+            index += Vx + 1;
+        }
+    }
 
     // Do nothing
-	void OP_NULL();
+	void OP_NULL(Instruction const& instruction);
 
     // CLS
-    void OP_00E0();
+    void OP_00E0(Instruction const& instruction);
+    // SCD n
+    void OP_00Cn(Instruction const& instruction);
+    // SCU n
+    void OP_00Dn(Instruction const& instruction);
+    // SCR
+    void OP_00FB(Instruction const& instruction);
+    // SCL
+    void OP_00FC(Instruction const& instruction);
+    // EXIT
+    void OP_00FD(Instruction const& instruction);
+    // LOW
+    void OP_00FE(Instruction const& instruction);
+    // HIGH
+    void OP_00FF(Instruction const& instruction);
     // RET
-    void OP_00EE();
+    void OP_00EE(Instruction const& instruction);
     // JP addr
-    void OP_1nnn();
+    void OP_1nnn(Instruction const& instruction);
     // CALL addr
-    void OP_2nnn();
+    void OP_2nnn(Instruction const& instruction);
     // SE Vx, byte
-    void OP_3xkk();
+    template <Quirks Q>
+    void OP_3xkk(Instruction const& instruction);
     // SNE Vx, byte
-    void OP_4xkk();
+    template <Quirks Q>
+    void OP_4xkk(Instruction const& instruction);
     // SE Vx, Vy
-    void OP_5xy0();
+    template <Quirks Q>
+    void OP_5xy0(Instruction const& instruction);
+    // SAVE Vx - Vy
+    void OP_5xy2(Instruction const& instruction);
+    // LOAD Vx - Vy
+    void OP_5xy3(Instruction const& instruction);
     // LD Vx, byte
-    void OP_6xkk();
+    void OP_6xkk(Instruction const& instruction);
     // ADD Vx, byte
-    void OP_7xkk();
+    void OP_7xkk(Instruction const& instruction);
     // Set Vx = Vy
-    void OP_8xy0();
+    void OP_8xy0(Instruction const& instruction);
     // OR Vx, Vy
-    void OP_8xy1();
+    template <Quirks Q>
+    void OP_8xy1(Instruction const& instruction);
     // AND Vx, Vy
-    void OP_8xy2();
+    template <Quirks Q>
+    void OP_8xy2(Instruction const& instruction);
     // XOR Vx, Vy
-    void OP_8xy3();
+    template <Quirks Q>
+    void OP_8xy3(Instruction const& instruction);
     // ADD Vx, Vy
-    void OP_8xy4();
+    void OP_8xy4(Instruction const& instruction);
     // SUB Vx, Vy
-    void OP_8xy5();
+    void OP_8xy5(Instruction const& instruction);
     // SHR Vx
-    void OP_8xy6();
+    template <Quirks Q>
+    void OP_8xy6(Instruction const& instruction);
     // SUBN Vx, Vy
-    void OP_8xy7();
+    void OP_8xy7(Instruction const& instruction);
     // SHL Vx {, Vy}
-    void OP_8xyE();
+    template <Quirks Q>
+    void OP_8xyE(Instruction const& instruction);
     // SNE Vx, Vy
-    void OP_9xy0();
+    template <Quirks Q>
+    void OP_9xy0(Instruction const& instruction);
     // LD I, addr
-    void OP_Annn();
-    // JP V0, addr
-    void OP_Bnnn();
+    void OP_Annn(Instruction const& instruction);
+    // JP V0, addr (or JP Vx, xnn)
+    template <Quirks Q>
+    void OP_Bnnn(Instruction const& instruction);
     // RND Vx, byte
-    void OP_Cxkk();
+    void OP_Cxkk(Instruction const& instruction);
     // DRW Vx, Vy, nibble
-    void OP_Dxyn();
+    template <Quirks Q>
+    void OP_Dxyn(Instruction const& instruction);
     // SKP Vx
-    void OP_Ex9E();
+    template <Quirks Q>
+    void OP_Ex9E(Instruction const& instruction);
     // SKNP Vx
-    void OP_ExA1();
+    template <Quirks Q>
+    void OP_ExA1(Instruction const& instruction);
+    // LD I, long addr
+    void OP_F000(Instruction const& instruction);
+    // PLANE n
+    void OP_Fn01(Instruction const& instruction);
+    // AUDIO
+    void OP_F002(Instruction const& instruction);
     // LD Vx, DT
-    void OP_Fx07();
+    void OP_Fx07(Instruction const& instruction);
     // LD Vx, K
-    void OP_Fx0A();
+    void OP_Fx0A(Instruction const& instruction);
     // LD DT, Vx
-    void OP_Fx15();
+    void OP_Fx15(Instruction const& instruction);
     // LD ST, Vx
-    void OP_Fx18();
+    void OP_Fx18(Instruction const& instruction);
     // ADD I, Vx
-    void OP_Fx1E();
+    void OP_Fx1E(Instruction const& instruction);
     // LD F, Vx
-    void OP_Fx29();
+    void OP_Fx29(Instruction const& instruction);
+    // LD HF, Vx
+    void OP_Fx30(Instruction const& instruction);
+    // PITCH Vx
+    void OP_Fx3A(Instruction const& instruction);
     // LD B, Vx
-    void OP_Fx33();
+    template <Quirks Q>
+    void OP_Fx33(Instruction const& instruction);
     // LD [I], Vx
-    void OP_Fx55();
+    template <Quirks Q>
+    void OP_Fx55(Instruction const& instruction);
     // LD Vx, [I]
-    void OP_Fx65();
+    template <Quirks Q>
+    void OP_Fx65(Instruction const& instruction);
+    // LD R, Vx
+    void OP_Fx75(Instruction const& instruction);
+    // LD Vx, R
+    void OP_Fx85(Instruction const& instruction);
 
-    uint8_t registers[16]{};
-    uint8_t memory[4096]{};
+    // the state nearly every instruction touches, together in one cache line
+    alignas(64) uint8_t registers[16]{};
     uint16_t index{};
     uint16_t pc{};
     uint16_t stack[16]{};
     uint8_t sp{};
     uint8_t delayTimer{};
     uint8_t soundTimer{};
-    uint16_t opcode;
+    // set when Fx0A found no key; pc stays on the Fx0A so a snapshot taken meanwhile needs no extra state
+    bool waitingForKey{};
+    // xorshift32 state; four bytes, so snapshots and replays capture the RNG exactly
+    uint32_t rngState{};
+    // written by whichever thread delivers input, read by the instructions that test keys
+    std::atomic<uint16_t> keypad{};
+
+    // addresses are masked to the profile's GetMemorySize(); memory points into image until the first store, then at
+    // ownMemory, which holds GetMemorySize() bytes
+    std::shared_ptr<Image const> image;
+    uint8_t const* memory{};
+    std::unique_ptr<uint8_t[]> ownMemory;
+    size_t ownMemorySize{};
+
+    // rows touched by OP_00E0/OP_Dxyn/scrolls since the frame was last presented
+    uint64_t dirtyRows{};
+    TraceWriter* trace{};
+    // see GetInstructions()
+    unsigned long long instructions{};
+
+    // SUPER-CHIP 128x64 mode
+    bool hires{};
+    // XO-CHIP bitplanes that drawing, clearing and scrolling apply to (bit n = plane n)
+    uint8_t planeMask = 1;
+    // SUPER-CHIP RPL user flags (Fx75/Fx85); XO-CHIP allows all sixteen
+    uint8_t userFlags[16]{};
+    // XO-CHIP audio: 128 one-bit samples and the playback pitch, 64 meaning 4000 Hz
+    uint8_t audioPattern[16]{};
+    uint8_t pitch = 64;
+
+    uint8_t RandomByte() {
+        rngState ^= rngState << 13u;
+        rngState ^= rngState >> 17u;
+        rngState ^= rngState << 5u;
+        return rngState >> 24u;
+    }
+
+    // bumped whenever memory is replaced wholesale (LoadROM, LoadState) so translated code can be dropped
+    uint32_t memoryEpoch{};
+
+    Quirks quirks = Quirks::Modern;
+    // GetMemorySize(quirks) - 1
+    uint16_t addressMask = MEMORY_SIZE - 1;
 
-    std::default_random_engine randGen;
-    std::uniform_int_distribution<uint8_t> randByte;
+    // decoded instruction for every address below MEMORY_SIZE: the image's, then ownDecoded, which Fetch() fills lazily
+    // and WriteMemory() invalidates
+    Instruction const* decoded{};
+    std::unique_ptr<Instruction[]> ownDecoded;
+    // Fetch() result for an address above the cache
+    Instruction uncached{};
 
-    typedef void (Chip8::*Chip8Func)();
-	Chip8Func table[0xF + 1];
-	Chip8Func table0[0xE + 1];
-	Chip8Func table8[0xE + 1];
-	Chip8Func tableE[0xE + 1];
-	Chip8Func tableF[0x65 + 1];
+    typedef void (Chip8::*Chip8Func)(Instruction const&);
+    // handler for every decoded opcode id, one table per quirk profile
+    template <Quirks Q>
+    static const Chip8Func opTable[static_cast<size_t>(Op::Count)];
+    // the table for the current profile, used by Cycle()
+    Chip8Func const* handlers = opTable<Quirks::Modern>;
 };
\ No newline at end of file
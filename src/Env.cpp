@@ -0,0 +1,224 @@
+#include <algorithm>
+#include <bitset>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Batch.hpp"
+#include "Chip8.hpp"
+#include "Env.h"
+
+// Shared observation buffers need POSIX shared memory
+#if defined(__unix__) || defined(__APPLE__)
+#define CHIP8_ENV_SHM 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+struct Chip8Env {
+    // the machine every reset starts from, with the ROM loaded
+    std::unique_ptr<Chip8> machine;
+    std::unique_ptr<Batch> batch;
+    unsigned int cyclesPerFrame{};
+
+    int format = CHIP8_ENV_BITS;
+    unsigned int downsample = 1;
+    // where observations go: ownObservations, the caller's buffer or the shared mapping
+    uint8_t* observations{};
+    std::vector<uint8_t> ownObservations;
+
+    void* shared{};
+    size_t sharedSize{};
+    std::string sharedName;
+};
+
+static bool IsValidFormat(int format, unsigned int downsample) {
+    return format == CHIP8_ENV_BITS
+        || (format == CHIP8_ENV_BYTES && (downsample == 1 || downsample == 2 || downsample == 4 || downsample == 8));
+}
+
+// The byte format: the share of lit pixels in each cell, scaled to 0-255
+static void Downsample(uint64_t const* rows, unsigned int downsample, uint8_t* out) {
+    uint64_t cellMask = (1ull << downsample) - 1;
+    unsigned int cellPixels = downsample * downsample;
+
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; y += downsample) {
+        for (unsigned int x = 0; x < VIDEO_WIDTH; x += downsample) {
+            unsigned int lit = 0;
+            for (unsigned int row = 0; row < downsample; ++row) {
+                lit += static_cast<unsigned int>(std::bitset<64>((rows[y + row] >> (VIDEO_WIDTH - downsample - x)) & cellMask).count());
+            }
+            *out++ = static_cast<uint8_t>(lit * 255u / cellPixels);
+        }
+    }
+}
+
+static void Unshare(Chip8Env* env) {
+#ifdef CHIP8_ENV_SHM
+    if (env->shared) {
+        munmap(env->shared, env->sharedSize);
+        shm_unlink(env->sharedName.c_str());
+        env->shared = nullptr;
+    }
+#else
+    (void)env;
+#endif
+}
+
+// Points the batch and the byte format at buffer
+static void Observe(Chip8Env* env, uint8_t* buffer, int format, unsigned int downsample) {
+    env->format = format;
+    env->downsample = downsample;
+    env->observations = buffer;
+
+    // the bit format is the batch's own screen layout, so it draws there directly
+    env->batch->SetVideo(format == CHIP8_ENV_BITS ? reinterpret_cast<uint64_t*>(buffer) : nullptr);
+    if (format == CHIP8_ENV_BYTES) {
+        for (unsigned int i = 0; i < env->batch->GetLaneCount(); ++i) {
+            Downsample(env->batch->GetVideo(i), downsample, buffer + i * chip8_env_observation_size(format, downsample));
+        }
+    }
+}
+
+extern "C" {
+
+Chip8Env* chip8_env_create(uint8_t const* rom, size_t size, unsigned int instances, char const* quirks,
+                           unsigned int cyclesPerFrame) {
+    Quirks profile = Quirks::Modern;
+    if ((quirks && !ParseQuirks(quirks, profile)) || !Batch::IsSupported(profile) || instances == 0) {
+        return nullptr;
+    }
+
+    std::unique_ptr<Chip8Env> env(new Chip8Env);
+    env->machine.reset(new Chip8(1));
+    env->machine->SetQuirks(profile);
+    if (!env->machine->LoadROM(rom, size)) {
+        return nullptr;
+    }
+    env->batch.reset(new Batch(instances));
+    env->batch->Reset(*env->machine);
+    env->cyclesPerFrame = cyclesPerFrame ? cyclesPerFrame : DEFAULT_CYCLES_PER_FRAME;
+
+    chip8_env_set_observations(env.get(), nullptr, CHIP8_ENV_BITS, 1);
+
+    return env.release();
+}
+
+void chip8_env_destroy(Chip8Env* env) {
+    if (env) {
+        // the batch must stop drawing into the mapping before it goes
+        env->batch->SetVideo(nullptr);
+        Unshare(env);
+        delete env;
+    }
+}
+
+unsigned int chip8_env_instances(Chip8Env const* env) {
+    return env->batch->GetLaneCount();
+}
+
+size_t chip8_env_observation_size(int format, unsigned int downsample) {
+    if (!IsValidFormat(format, downsample)) {
+        return 0;
+    }
+
+    return format == CHIP8_ENV_BITS ? VIDEO_HEIGHT * sizeof(uint64_t)
+                                    : (VIDEO_WIDTH / downsample) * (VIDEO_HEIGHT / downsample);
+}
+
+int chip8_env_set_observations(Chip8Env* env, void* buffer, int format, unsigned int downsample) {
+    if (!IsValidFormat(format, downsample)) {
+        return 0;
+    }
+
+    uint8_t* target = static_cast<uint8_t*>(buffer);
+    if (!target) {
+        // the batch may be drawing into ownObservations, which resizing can move
+        env->batch->SetVideo(nullptr);
+        env->ownObservations.resize(env->batch->GetLaneCount() * chip8_env_observation_size(format, downsample));
+        target = env->ownObservations.data();
+    }
+    Observe(env, target, format, downsample);
+    Unshare(env);
+
+    return 1;
+}
+
+void* chip8_env_share_observations(Chip8Env* env, char const* name, int format, unsigned int downsample) {
+#ifdef CHIP8_ENV_SHM
+    if (!IsValidFormat(format, downsample)) {
+        return nullptr;
+    }
+
+    size_t size = env->batch->GetLaneCount() * chip8_env_observation_size(format, downsample);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        return nullptr;
+    }
+    void* memory = ftruncate(fd, static_cast<off_t>(size)) == 0
+        ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (memory == MAP_FAILED) {
+        shm_unlink(name);
+        return nullptr;
+    }
+
+    Observe(env, static_cast<uint8_t*>(memory), format, downsample);
+    Unshare(env);
+    env->shared = memory;
+    env->sharedSize = size;
+    env->sharedName = name;
+
+    return memory;
+#else
+    (void)env;
+    (void)name;
+    (void)format;
+    (void)downsample;
+    return nullptr;
+#endif
+}
+
+void const* chip8_env_observations(Chip8Env const* env) {
+    return env->observations;
+}
+
+void chip8_env_reset(Chip8Env* env, uint32_t seed) {
+    Batch& batch = *env->batch;
+
+    batch.Reset(*env->machine);
+    for (unsigned int i = 0; i < batch.GetLaneCount(); ++i) {
+        batch.SetSeed(i, seed + i);
+    }
+    Observe(env, env->observations, env->format, env->downsample);
+}
+
+void chip8_env_fork(Chip8Env* env, unsigned int parent, unsigned int child) {
+    env->batch->Fork(parent, child);
+
+    if (env->format == CHIP8_ENV_BYTES) {
+        size_t size = chip8_env_observation_size(env->format, env->downsample);
+        std::copy(env->observations + parent * size, env->observations + (parent + 1) * size,
+                  env->observations + child * size);
+    }
+}
+
+void chip8_env_step_batch(Chip8Env* env, uint16_t const* actions, unsigned int frames) {
+    Batch& batch = *env->batch;
+
+    for (unsigned int i = 0; i < batch.GetLaneCount(); ++i) {
+        batch.SetKeys(i, actions[i]);
+    }
+    for (unsigned int frame = 0; frame < frames; ++frame) {
+        batch.RunFrame(env->cyclesPerFrame);
+    }
+
+    if (env->format == CHIP8_ENV_BYTES) {
+        size_t size = chip8_env_observation_size(env->format, env->downsample);
+        for (unsigned int i = 0; i < batch.GetLaneCount(); ++i) {
+            Downsample(batch.GetVideo(i), env->downsample, env->observations + i * size);
+        }
+    }
+}
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+/* Step-based environment for agent training: a batch of copies of one ROM, driven a step at a time.
+ * A plain C interface, so the library can be loaded from Python (ctypes, cffi) or any other language.
+ *
+ * Observations are written into one buffer, every instance's frame one after the other. The buffer is either the
+ * library's own, one the caller supplies (a NumPy array, say), or a POSIX shared memory object that another process
+ * maps. Nothing is allocated or copied per step: in the bit format the instances draw straight into the buffer, and
+ * the byte format is computed into it at the end of each step. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* VIDEO_HEIGHT 64-bit rows per instance, in host byte order, the most significant bit being the leftmost pixel */
+#define CHIP8_ENV_BITS 0
+/* one byte per cell of downsample x downsample pixels, row by row: 0 for unlit up to 255 for all lit */
+#define CHIP8_ENV_BYTES 1
+
+typedef struct Chip8Env Chip8Env;
+
+/* Loads a ROM into instances copies under a quirk profile ("vip", "chip48" or "modern"; null means modern), each
+ * step frame running cyclesPerFrame instructions (0 for the default). Observations start out in the bit format in the
+ * library's own buffer. Returns null if the ROM does not fit or the profile cannot be batched */
+Chip8Env* chip8_env_create(uint8_t const* rom, size_t size, unsigned int instances, char const* quirks,
+                           unsigned int cyclesPerFrame);
+void chip8_env_destroy(Chip8Env* env);
+
+unsigned int chip8_env_instances(Chip8Env const* env);
+/* Bytes one instance's observation takes in a format; downsample must be 1, 2, 4 or 8 for CHIP8_ENV_BYTES.
+ * Returns 0 if the format is not valid */
+size_t chip8_env_observation_size(int format, unsigned int downsample);
+
+/* Writes observations into buffer from now on, which must hold chip8_env_instances() observations of that format
+ * and, for the bit format, be 8-byte aligned; null selects the library's own buffer. Returns 0 if the format is not
+ * valid */
+int chip8_env_set_observations(Chip8Env* env, void* buffer, int format, unsigned int downsample);
+/* The same, into a new POSIX shared memory object called name that other processes can map read-only. The object is
+ * removed by chip8_env_destroy(). Returns the mapping, or null if it could not be created */
+void* chip8_env_share_observations(Chip8Env* env, char const* name, int format, unsigned int downsample);
+/* The buffer observations are written into */
+void const* chip8_env_observations(Chip8Env const* env);
+
+/* Starts every instance over from the loaded ROM, instance i with RNG seed seed + i */
+void chip8_env_reset(Chip8Env* env, uint32_t seed);
+/* Makes instance child a copy of instance parent, to branch a search from parent's state. Memory is shared until
+ * either of them stores into it, so a fork costs about as much as copying one observation */
+void chip8_env_fork(Chip8Env* env, unsigned int parent, unsigned int child);
+/* Holds down actions[i] (bit n = key n) on instance i and runs frames frames of every instance, then updates the
+ * observations */
+void chip8_env_step_batch(Chip8Env* env, uint16_t const* actions, unsigned int frames);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,109 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "Env.h"
+
+// Stands in for a training client: drives the environment library the way an agent loop would, with random actions,
+// and reports how many steps it takes a second
+int main(int argc, char** argv) {
+    if (argc < 5)
+    {
+        std::cerr << "Usage: " << argv[0] << " <Instances> <Steps> <FramesPerStep> <ROM> [--quirks <Profile>]"
+                  << " [--bytes <Downsample>] [--shared <Name>]\n";
+        std::exit(EXIT_FAILURE);
+    }
+
+    unsigned int instances = std::stoul(argv[1]);
+    unsigned long long steps = std::stoull(argv[2]);
+    unsigned int framesPerStep = std::stoul(argv[3]);
+
+    std::ifstream file(argv[4], std::ios::binary);
+    std::vector<uint8_t> rom((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (!file.good() && !file.eof())
+    {
+        std::cerr << "Could not load ROM '" << argv[4] << "'\n";
+        std::exit(EXIT_FAILURE);
+    }
+
+    char const* quirks = nullptr;
+    int format = CHIP8_ENV_BITS;
+    unsigned int downsample = 1;
+    char const* sharedName = nullptr;
+    for (int arg = 5; arg + 1 < argc; arg += 2)
+    {
+        if (std::strcmp(argv[arg], "--quirks") == 0)
+        {
+            quirks = argv[arg + 1];
+        }
+        else if (std::strcmp(argv[arg], "--bytes") == 0)
+        {
+            format = CHIP8_ENV_BYTES;
+            downsample = std::stoul(argv[arg + 1]);
+        }
+        else if (std::strcmp(argv[arg], "--shared") == 0)
+        {
+            sharedName = argv[arg + 1];
+        }
+    }
+
+    Chip8Env* env = chip8_env_create(rom.data(), rom.size(), instances, quirks, 0);
+    if (!env)
+    {
+        std::cerr << "Could not create the environment, expected a ROM that fits and vip, chip48 or modern quirks\n";
+        std::exit(EXIT_FAILURE);
+    }
+
+    bool observing = sharedName ? chip8_env_share_observations(env, sharedName, format, downsample) != nullptr
+                                : chip8_env_set_observations(env, nullptr, format, downsample) != 0;
+    if (!observing)
+    {
+        std::cerr << "Could not set up the observation buffer\n";
+        chip8_env_destroy(env);
+        std::exit(EXIT_FAILURE);
+    }
+
+    size_t observationSize = chip8_env_observation_size(format, downsample);
+    uint8_t const* observations = static_cast<uint8_t const*>(chip8_env_observations(env));
+    std::vector<uint16_t> actions(instances);
+    uint32_t rng = 1;
+    // a stand-in for whatever the agent would compute from the observations
+    unsigned long long checksum = 0;
+
+    chip8_env_reset(env, 1);
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long long step = 0; step < steps; ++step)
+    {
+        for (unsigned int i = 0; i < instances; ++i)
+        {
+            // xorshift; mostly one key down at a time, sometimes none
+            rng ^= rng << 13;
+            rng ^= rng >> 17;
+            rng ^= rng << 5;
+            actions[i] = (rng & 0x10u) ? 0 : static_cast<uint16_t>(1u << (rng & 0xFu));
+        }
+        chip8_env_step_batch(env, actions.data(), framesPerStep);
+        for (unsigned int i = 0; i < instances; ++i)
+        {
+            checksum += observations[i * observationSize];
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "instances: " << instances << "\n";
+    std::cout << "observation bytes: " << observationSize << "\n";
+    std::cout << "seconds: " << seconds << "\n";
+    std::cout << "steps/s: " << steps / seconds << "\n";
+    std::cout << "instance steps/s: " << steps * instances / seconds << "\n";
+    std::cout << "frames/s: " << steps * instances * framesPerStep / seconds << "\n";
+    std::cout << "checksum: " << checksum << "\n";
+
+    chip8_env_destroy(env);
+
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include "Chip8.hpp"
+#include "Env.h"
+
+const unsigned int INSTANCES = 37;
+const unsigned int CYCLES_PER_FRAME = 9;
+const unsigned int FRAMES_PER_STEP = 3;
+const unsigned int STEPS = 8;
+
+// Draws a digit picked by Cxkk at a position picked by the keys, forever, so every instance's screen differs
+static std::vector<uint8_t> MakeRom() {
+    return {
+        0x00, 0xE0, // 200: CLS
+        0xC0, 0x0F, // 202: V0 = random & 0x0F
+        0xF0, 0x29, // 204: I = digit V0
+        0x61, 0x00, // 206: V1 = 0
+        0xE1, 0xA1, // 208: skip if key V1 is not down
+        0x71, 0x08, // 20A: V1 += 8
+        0x62, 0x03, // 20C: V2 = 3
+        0xD1, 0x25, // 20E: draw the digit at V1, V2
+        0x12, 0x02, // 210: jump to 202
+    };
+}
+
+// The observation of one reference machine, as the library lays it out
+static void Expect(Chip8 const& chip8, int format, unsigned int downsample, uint8_t* out) {
+    if (format == CHIP8_ENV_BITS) {
+        for (unsigned int y = 0; y < VIDEO_HEIGHT; ++y) {
+            memcpy(out + y * sizeof(uint64_t), &chip8.video[0][y][0], sizeof(uint64_t));
+        }
+        return;
+    }
+
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; y += downsample) {
+        for (unsigned int x = 0; x < VIDEO_WIDTH; x += downsample) {
+            unsigned int lit = 0;
+            for (unsigned int row = 0; row < downsample; ++row) {
+                for (unsigned int column = 0; column < downsample; ++column) {
+                    lit += (chip8.video[0][y + row][0] >> (VIDEO_WIDTH - 1 - x - column)) & 1u;
+                }
+            }
+            *out++ = static_cast<uint8_t>(lit * 255u / (downsample * downsample));
+        }
+    }
+}
+
+// Checks the library's observations against machines run on their own, after every step
+int main() {
+    std::vector<uint8_t> rom = MakeRom();
+    Chip8Env* env = chip8_env_create(rom.data(), rom.size(), INSTANCES, "chip48", CYCLES_PER_FRAME);
+    if (!env)
+    {
+        std::cerr << "Could not create the environment\n";
+        std::exit(EXIT_FAILURE);
+    }
+
+    std::vector<std::unique_ptr<Chip8>> machines;
+    for (unsigned int i = 0; i < INSTANCES; ++i)
+    {
+        machines.emplace_back(new Chip8(1 + i));
+        machines[i]->SetQuirks(Quirks::Chip48);
+        machines[i]->LoadROM(rom.data(), rom.size());
+    }
+    chip8_env_reset(env, 1);
+
+    // each pass switches format on the library's own buffer, which grows, shrinks and moves as it does
+    struct Format {
+        int format;
+        unsigned int downsample;
+    };
+    Format const formats[] = {
+        {CHIP8_ENV_BITS, 1}, {CHIP8_ENV_BYTES, 1}, {CHIP8_ENV_BITS, 1}, {CHIP8_ENV_BYTES, 2},
+        {CHIP8_ENV_BYTES, 8}, {CHIP8_ENV_BYTES, 1}, {CHIP8_ENV_BITS, 1}, {CHIP8_ENV_BYTES, 4},
+    };
+
+    std::vector<uint16_t> actions(INSTANCES);
+    std::vector<uint8_t> expected;
+    unsigned int failures = 0;
+    for (Format const& format : formats)
+    {
+        if (!chip8_env_set_observations(env, nullptr, format.format, format.downsample))
+        {
+            std::cerr << "Could not switch to format " << format.format << "/" << format.downsample << "\n";
+            ++failures;
+            continue;
+        }
+        size_t size = chip8_env_observation_size(format.format, format.downsample);
+        expected.resize(size);
+
+        for (unsigned int step = 0; step < STEPS; ++step)
+        {
+            for (unsigned int i = 0; i < INSTANCES; ++i)
+            {
+                actions[i] = static_cast<uint16_t>(((i + step) % 3) ? 1u : 0u);
+                machines[i]->SetKeys(actions[i]);
+                for (unsigned int frame = 0; frame < FRAMES_PER_STEP; ++frame)
+                {
+                    machines[i]->RunFrame(CYCLES_PER_FRAME);
+                }
+            }
+            chip8_env_step_batch(env, actions.data(), FRAMES_PER_STEP);
+
+            uint8_t const* observations = static_cast<uint8_t const*>(chip8_env_observations(env));
+            for (unsigned int i = 0; i < INSTANCES; ++i)
+            {
+                Expect(*machines[i], format.format, format.downsample, expected.data());
+                if (memcmp(expected.data(), observations + i * size, size) != 0)
+                {
+                    std::cerr << "Format " << format.format << "/" << format.downsample << ", step " << step
+                              << ": instance " << i << " differs\n";
+                    ++failures;
+                    break;
+                }
+            }
+        }
+    }
+
+    chip8_env_destroy(env);
+
+    std::cout << (failures ? "FAILED" : "passed") << "\n";
+
+    return failures ? EXIT_FAILURE : 0;
+}
@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "Fleet.hpp"
+
+// FNV-1a hash of the video buffer, so results can be compared without dumping every frame
+static uint32_t HashVideo(Chip8 const& chip8) {
+    uint32_t hash = 2166136261u;
+
+    for (auto const& plane : chip8.video) {
+        for (auto const& row : plane) {
+            for (uint64_t word : row) {
+                for (unsigned int byte = 0; byte < 8; ++byte) {
+                    hash ^= (word >> (56u - 8u * byte)) & 0xFFu;
+                    hash *= 16777619u;
+                }
+            }
+        }
+    }
+
+    return hash;
+}
+
+Fleet::Fleet(unsigned int threadCount, unsigned int cyclesPerFrame)
+    : threadCount(threadCount), cyclesPerFrame(cyclesPerFrame) {
+    // default to one worker per hardware thread
+    if (this->threadCount == 0) {
+        this->threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    queues.reset(new WorkQueue[this->threadCount]);
+}
+
+bool Fleet::Add(char const* romFilename, unsigned long long frames, unsigned int seed, Quirks quirks) {
+    // copies of one ROM share its image (memory and decoding) until they store to memory; everything else an instance
+    // owns, including its RNG and quirk profile
+    std::shared_ptr<Chip8::Image const>& image = images[romFilename];
+    if (!image) {
+        image = Chip8::MakeImage(romFilename);
+        if (!image) {
+            images.erase(romFilename);
+            return false;
+        }
+    }
+
+    Instance instance;
+    instance.chip8.reset(new Chip8(seed));
+    instance.chip8->SetQuirks(quirks);
+    instance.romFilename = romFilename;
+    instance.remainingFrames = frames;
+
+    if (!instance.chip8->LoadROM(image)) {
+        return false;
+    }
+
+    instances.push_back(std::move(instance));
+    return true;
+}
+
+void Fleet::Run(unsigned int sliceFrames) {
+    // deal the instances out round-robin; workers steal from each other once their own queue runs dry
+    pending = 0;
+    for (size_t i = 0; i < instances.size(); ++i) {
+        if (instances[i].remainingFrames > 0) {
+            queues[i % threadCount].instances.push_back(i);
+            ++pending;
+        }
+    }
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    std::vector<std::thread> workers;
+    for (unsigned int id = 0; id < threadCount; ++id) {
+        workers.emplace_back(&Fleet::Worker, this, id, std::max(1u, sliceFrames));
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    seconds = std::chrono::duration<double>(endTime - startTime).count();
+}
+
+unsigned long long Fleet::GetTotalInstructions() const {
+    unsigned long long total = 0;
+
+    for (Instance const& instance : instances) {
+        total += instance.chip8->GetInstructions();
+    }
+
+    return total;
+}
+
+unsigned long long Fleet::GetTotalFrames() const {
+    unsigned long long total = 0;
+
+    for (Instance const& instance : instances) {
+        total += instance.executedFrames;
+    }
+
+    return total;
+}
+
+std::vector<Fleet::Result> Fleet::GetResults() const {
+    std::vector<Result> results;
+
+    for (Instance const& instance : instances) {
+        Result result;
+        result.romFilename = instance.romFilename;
+        result.frames = instance.executedFrames;
+        result.instructions = instance.chip8->GetInstructions();
+        result.pc = instance.chip8->GetPC();
+        result.videoHash = HashVideo(*instance.chip8);
+        results.push_back(result);
+    }
+
+    return results;
+}
+
+void Fleet::Worker(unsigned int id, unsigned int sliceFrames) {
+    size_t current;
+
+    while (pending > 0) {
+        // prefer our own queue, otherwise try to take work from another worker
+        if (!Pop(id, current) && !Steal(id, current)) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // run one time slice; only this worker touches the instance until it is queued again
+        Instance& instance = instances[current];
+        unsigned long long slice = std::min<unsigned long long>(sliceFrames, instance.remainingFrames);
+
+        for (unsigned long long frame = 0; frame < slice; ++frame) {
+            instance.chip8->RunFrame(cyclesPerFrame);
+        }
+
+        instance.remainingFrames -= slice;
+        instance.executedFrames += slice;
+
+        // requeue unfinished instances locally so they stay warm in this core's cache
+        if (instance.remainingFrames > 0) {
+            Push(id, current);
+        } else {
+            --pending;
+        }
+    }
+}
+
+bool Fleet::Pop(unsigned int id, size_t& instance) {
+    std::lock_guard<std::mutex> guard(queues[id].lock);
+
+    // owners take from the back
+    if (queues[id].instances.empty()) {
+        return false;
+    }
+
+    instance = queues[id].instances.back();
+    queues[id].instances.pop_back();
+    return true;
+}
+
+bool Fleet::Steal(unsigned int id, size_t& instance) {
+    // thieves take from the front, starting with the next worker along so victims are spread out
+    for (unsigned int i = 1; i < threadCount; ++i) {
+        WorkQueue& victim = queues[(id + i) % threadCount];
+        std::lock_guard<std::mutex> guard(victim.lock);
+
+        if (!victim.instances.empty()) {
+            instance = victim.instances.front();
+            victim.instances.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Fleet::Push(unsigned int id, size_t instance) {
+    std::lock_guard<std::mutex> guard(queues[id].lock);
+
+    queues[id].instances.push_back(instance);
+}
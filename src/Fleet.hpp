@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Chip8.hpp"
+
+// Runs many independent Chip8 instances in-process, spread across a work-stealing thread pool
+class Fleet {
+public:
+    // Per-instance outcome, filled in by Run()
+    struct Result {
+        std::string romFilename;
+        unsigned long long frames{};
+        // executed, see Chip8::GetInstructions()
+        unsigned long long instructions{};
+        uint16_t pc{};
+        uint32_t videoHash{};
+    };
+
+    // Creates a fleet that will use threadCount workers (0 = one per hardware thread), each frame being cyclesPerFrame instructions
+    Fleet(unsigned int threadCount, unsigned int cyclesPerFrame);
+
+    // Adds an instance that will run the ROM for the given number of frames; returns false if the ROM cannot be loaded
+    bool Add(char const* romFilename, unsigned long long frames, unsigned int seed, Quirks quirks = Quirks::Modern);
+    // Runs every instance to completion, stepping each in slices of sliceFrames frames
+    void Run(unsigned int sliceFrames);
+
+    unsigned int GetThreadCount() const { return threadCount; }
+    unsigned long long GetTotalInstructions() const;
+    // Frames run, including those an instance spent parked on Fx0A, which execute nothing
+    unsigned long long GetTotalFrames() const;
+    // Wall-clock duration of the last Run() in seconds
+    double GetSeconds() const { return seconds; }
+    std::vector<Result> GetResults() const;
+
+private:
+    // Workers update an instance's counters after every slice; padded so instances run by different workers do
+    // not share a cache line
+    struct alignas(64) Instance {
+        std::unique_ptr<Chip8> chip8;
+        std::string romFilename;
+        unsigned long long remainingFrames{};
+        unsigned long long executedFrames{};
+    };
+
+    // One deque per worker; padded so neighbouring workers' locks do not share a cache line
+    struct alignas(64) WorkQueue {
+        std::mutex lock;
+        std::deque<size_t> instances;
+    };
+
+    void Worker(unsigned int id, unsigned int sliceFrames);
+    bool Pop(unsigned int id, size_t& instance);
+    bool Steal(unsigned int id, size_t& instance);
+    void Push(unsigned int id, size_t instance);
+
+    unsigned int threadCount{};
+    unsigned int cyclesPerFrame{};
+    double seconds{};
+    std::vector<Instance> instances;
+    // one per ROM file added, shared by its instances
+    std::unordered_map<std::string, std::shared_ptr<Chip8::Image const>> images;
+    std::unique_ptr<WorkQueue[]> queues;
+    std::atomic<size_t> pending{};
+};
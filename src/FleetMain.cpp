@@ -0,0 +1,76 @@
+#include <iomanip>
+#include <iostream>
+#include <cstring>
+#include <string>
+#include "Fleet.hpp"
+
+// number of frames an instance runs before it goes back on its worker's queue
+const unsigned int SLICE_FRAMES = 1000;
+
+int main(int argc, char** argv) {
+    // runs Copies instances of every ROM across Threads workers, each for Frames frames
+    if (argc < 5)
+    {
+        std::cerr << "Usage: " << argv[0] << " <Threads> <Copies> <Frames> [--quirks <Profile>] <ROM>...\n";
+        std::exit(EXIT_FAILURE);
+    }
+
+    // 0 uses one worker per hardware thread
+    unsigned int threads = std::stoul(argv[1]);
+    unsigned int copies = std::stoul(argv[2]);
+    unsigned long long frames = std::stoull(argv[3]);
+
+    Fleet fleet(threads, DEFAULT_CYCLES_PER_FRAME);
+
+    // each instance gets its own seed so copies of one ROM do not run in lockstep;
+    // --quirks applies to the ROMs after it, so one run can mix libraries written for different interpreters
+    unsigned int seed = 1;
+    Quirks quirks = Quirks::Modern;
+    for (int arg = 4; arg < argc; ++arg)
+    {
+        if (std::strcmp(argv[arg], "--quirks") == 0 && arg + 1 < argc)
+        {
+            if (!ParseQuirks(argv[++arg], quirks))
+            {
+                std::cerr << "Unknown quirks '" << argv[arg] << "', expected vip, chip48, schip, modern or xochip\n";
+                std::exit(EXIT_FAILURE);
+            }
+            continue;
+        }
+
+        for (unsigned int copy = 0; copy < copies; ++copy)
+        {
+            if (!fleet.Add(argv[arg], frames, seed++, quirks))
+            {
+                std::cerr << "Could not load ROM '" << argv[arg] << "'\n";
+                std::exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    fleet.Run(SLICE_FRAMES);
+
+    // per-instance results, then the aggregate throughput
+    std::vector<Fleet::Result> results = fleet.GetResults();
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        std::cout << i << " " << results[i].romFilename
+                  << " frames=" << results[i].frames
+                  << " instructions=" << results[i].instructions
+                  << std::hex << std::setfill('0')
+                  << " pc=" << std::setw(3) << results[i].pc
+                  << " video=" << std::setw(8) << results[i].videoHash
+                  << std::dec << std::setfill(' ') << "\n";
+    }
+
+    double seconds = fleet.GetSeconds();
+    unsigned long long totalInstructions = fleet.GetTotalInstructions();
+
+    std::cout << "instances: " << results.size() << "\n";
+    std::cout << "threads: " << fleet.GetThreadCount() << "\n";
+    std::cout << "seconds: " << seconds << "\n";
+    std::cout << "MIPS: " << (seconds > 0.0 ? totalInstructions / seconds / 1e6 : 0.0) << "\n";
+    std::cout << "frames/s: " << (seconds > 0.0 ? fleet.GetTotalFrames() / seconds : 0.0) << "\n";
+
+    return 0;
+}
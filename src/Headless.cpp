@@ -0,0 +1,252 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include "Chip8.hpp"
+#include "InputLog.hpp"
+#include "Jit.hpp"
+#include "Trace.hpp"
+
+// RNG seed used unless --seed or a replayed log chooses one, so runs are comparable between builds
+const unsigned int DEFAULT_SEED = 1;
+
+// prints the registers, index, pc, stack pointer and timers
+static void DumpRegisters(Chip8 const& chip8) {
+    uint8_t const* registers = chip8.GetRegisters();
+
+    std::cout << std::hex << std::uppercase << std::setfill('0');
+    for (unsigned int i = 0; i < 16; ++i) {
+        std::cout << "V" << i << "=" << std::setw(2) << static_cast<unsigned int>(registers[i]);
+        std::cout << ((i % 8 == 7) ? "\n" : " ");
+    }
+    std::cout << "I=" << std::setw(3) << chip8.GetIndex()
+              << " PC=" << std::setw(3) << chip8.GetPC()
+              << " SP=" << std::setw(1) << static_cast<unsigned int>(chip8.GetSP())
+              << " DT=" << std::setw(2) << static_cast<unsigned int>(chip8.GetDelayTimer())
+              << " ST=" << std::setw(2) << static_cast<unsigned int>(chip8.GetSoundTimer()) << "\n";
+    std::cout << std::dec << std::setfill(' ');
+}
+
+// prints the video buffer as text at its current resolution, one character per pixel: '#' for the first plane,
+// '+' for the second and '@' where both are lit
+static void DumpVideo(Chip8 const& chip8) {
+    static char const PIXELS[4] = {'.', '#', '+', '@'};
+
+    for (unsigned int y = 0; y < chip8.GetVideoHeight(); ++y) {
+        for (unsigned int x = 0; x < chip8.GetVideoWidth(); ++x) {
+            unsigned int pixel = 0;
+            for (unsigned int plane = 0; plane < VIDEO_PLANES; ++plane) {
+                pixel |= ((chip8.video[plane][y][x / 64] >> (63 - x % 64)) & 1u) << plane;
+            }
+            std::cout << PIXELS[pixel];
+        }
+        std::cout << "\n";
+    }
+}
+
+int main(int argc, char** argv) {
+    // options come before the positional arguments
+    bool useJit = false;
+    bool haveSeed = false;
+    unsigned int seed = DEFAULT_SEED;
+    char const* replayFilename = nullptr;
+    char const* traceFilename = nullptr;
+    bool haveQuirks = false;
+    Quirks quirks = Quirks::Modern;
+    int arg = 1;
+    while (arg < argc && std::strncmp(argv[arg], "--", 2) == 0)
+    {
+        if (std::strcmp(argv[arg], "--jit") == 0)
+        {
+            useJit = true;
+        }
+        else if (std::strcmp(argv[arg], "--seed") == 0 && arg + 1 < argc)
+        {
+            seed = std::stoul(argv[++arg]);
+            haveSeed = true;
+        }
+        else if (std::strcmp(argv[arg], "--replay") == 0 && arg + 1 < argc)
+        {
+            replayFilename = argv[++arg];
+        }
+        else if (std::strcmp(argv[arg], "--trace") == 0 && arg + 1 < argc)
+        {
+            traceFilename = argv[++arg];
+        }
+        else if (std::strcmp(argv[arg], "--quirks") == 0 && arg + 1 < argc)
+        {
+            if (!ParseQuirks(argv[++arg], quirks))
+            {
+                std::cerr << "Unknown quirks '" << argv[arg] << "', expected vip, chip48, schip, modern or xochip\n";
+                std::exit(EXIT_FAILURE);
+            }
+            haveQuirks = true;
+        }
+        else
+        {
+            std::cerr << "Unknown option '" << argv[arg] << "'\n";
+            std::exit(EXIT_FAILURE);
+        }
+        ++arg;
+    }
+    argv += arg - 1;
+    argc -= arg - 1;
+
+    // runs a ROM without a window for a fixed number of cycles or frames, as fast as possible
+    if (argc != 4 && argc != 5)
+	{
+		std::cerr << "Usage: " << argv[0] << " [--jit] [--seed <Seed>] [--replay <InputLog>] [--quirks <Profile>] [--trace <File>] <cycles|frames> <Count> <ROM> [CyclesPerFrame]\n";
+		std::exit(EXIT_FAILURE);
+	}
+
+    // "cycles" counts single instructions, "frames" counts groups of CyclesPerFrame instructions
+    bool frameMode = std::strcmp(argv[1], "frames") == 0;
+    if (!frameMode && std::strcmp(argv[1], "cycles") != 0)
+    {
+        std::cerr << "Unknown mode '" << argv[1] << "', expected 'cycles' or 'frames'\n";
+        std::exit(EXIT_FAILURE);
+    }
+
+    unsigned long long count = std::stoull(argv[2]);
+    char const* romFilename = argv[3];
+    unsigned int cyclesPerFrame = (argc == 5) ? std::stoul(argv[4]) : DEFAULT_CYCLES_PER_FRAME;
+
+    // a replayed log brings the seed, instruction rate and quirks it was recorded with, unless overridden here
+    InputLog inputLog;
+    if (replayFilename)
+    {
+        if (!inputLog.Load(replayFilename))
+        {
+            std::cerr << "Could not load input log '" << replayFilename << "'\n";
+            std::exit(EXIT_FAILURE);
+        }
+        if (!haveSeed)
+        {
+            seed = inputLog.GetSeed();
+        }
+        if (argc != 5)
+        {
+            cyclesPerFrame = inputLog.GetCyclesPerFrame();
+        }
+        if (!haveQuirks)
+        {
+            quirks = inputLog.GetQuirks();
+        }
+        std::cerr << "replay: " << inputLog.GetFrames() << " frames recorded\n";
+    }
+    if (cyclesPerFrame == 0)
+    {
+        std::cerr << "CyclesPerFrame must be at least 1\n";
+        std::exit(EXIT_FAILURE);
+    }
+
+	Chip8 chip8(seed);
+	chip8.SetQuirks(quirks);
+	if (!chip8.LoadROM(romFilename))
+    {
+        std::cerr << "Could not load ROM '" << romFilename << "'\n";
+        std::exit(EXIT_FAILURE);
+    }
+
+    // every instruction from the first one on, with the state it leaves
+    TraceWriter trace;
+    if (traceFilename)
+    {
+        if (!trace.Open(traceFilename, chip8.GetPC(), chip8.GetIndex(), chip8.GetRegisters()))
+        {
+            std::cerr << "Could not create trace '" << traceFilename << "'\n";
+            std::exit(EXIT_FAILURE);
+        }
+        chip8.SetTrace(&trace);
+    }
+
+    unsigned long long cycles = frameMode ? count * cyclesPerFrame : count;
+
+    // runs the emulation loop with no throttling, input or rendering
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+    // translated blocks where possible, the interpreter for everything else
+    std::unique_ptr<Jit> jit;
+    if (useJit)
+    {
+        jit.reset(new Jit(chip8));
+    }
+
+    // one burst per frame keeps the dispatch loop tight between boundaries
+    unsigned long long frame = 0;
+    for (unsigned long long remaining = cycles; remaining > 0; ++frame)
+    {
+        // input only changes between frames, exactly as in the windowed frontend
+        if (replayFilename)
+        {
+            chip8.SetKeys(inputLog.Replay(frame));
+        }
+
+        unsigned int burst = static_cast<unsigned int>(std::min<unsigned long long>(remaining, cyclesPerFrame));
+
+        if (jit)
+        {
+            jit->Run(burst);
+        }
+        else
+        {
+            chip8.Run(burst);
+        }
+        remaining -= burst;
+
+        // every complete frame ends with one 60 Hz timer tick
+        if (burst == cyclesPerFrame)
+        {
+            chip8.TickTimers();
+        }
+    }
+
+    if (jit)
+    {
+        std::cerr << "jit: " << jit->GetNativeInstructions() << " native, "
+                  << jit->GetInterpretedInstructions() << " interpreted"
+                  << (Jit::IsSupported() ? "" : " (no native code on this host)") << "\n";
+    }
+
+    // the trace is part of the run, so draining it to disk is timed as well
+    if (traceFilename)
+    {
+        chip8.SetTrace(nullptr);
+        if (!trace.Close())
+        {
+            std::cerr << "Could not write trace '" << traceFilename << "'\n";
+            std::exit(EXIT_FAILURE);
+        }
+        std::cerr << "trace: " << trace.GetCount() << " instructions, " << trace.GetBytes() << " bytes\n";
+    }
+
+	auto endTime = std::chrono::high_resolution_clock::now();
+	double seconds = std::chrono::duration<double>(endTime - startTime).count();
+
+    // reports throughput, then the final machine state; skipped idle loops and a parked Fx0A use up cycles without
+    // executing instructions, so the rate is of the instructions actually executed
+    unsigned long long instructions = chip8.GetInstructions();
+    std::cout << "cycles: " << cycles << "\n";
+    if (frameMode)
+    {
+        std::cout << "frames: " << count << " (" << cyclesPerFrame << " cycles/frame)\n";
+    }
+    std::cout << "instructions: " << instructions << "\n";
+    std::cout << "seconds: " << seconds << "\n";
+    std::cout << "instructions/sec: " << (seconds > 0.0 ? instructions / seconds : 0.0) << "\n";
+    // a frame parked on Fx0A still counts here, though it executes nothing
+    if (frameMode)
+    {
+        std::cout << "frames/sec: " << (seconds > 0.0 ? count / seconds : 0.0) << "\n";
+    }
+
+    DumpRegisters(chip8);
+    DumpVideo(chip8);
+    std::cout << "checksum: " << std::hex << std::setfill('0') << std::setw(16) << chip8.Checksum()
+              << std::dec << std::setfill(' ') << "\n";
+
+	return 0;
+}
@@ -0,0 +1,174 @@
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "Chip8.hpp"
+
+const unsigned int ROMS = 3000;
+const unsigned int FRAMES = 100;
+// up to IDLE_LOOP_LENGTH in Chip8.cpp, so some loops are too long to be probed
+const unsigned int MAX_LOOP_INSTRUCTIONS = 18;
+const unsigned int MAX_CYCLES_PER_FRAME = 200;
+const Quirks PROFILES[] = {Quirks::Vip, Quirks::Chip48, Quirks::Schip, Quirks::Modern, Quirks::XoChip};
+
+static void Append(std::vector<uint16_t>& code, uint16_t opcode) {
+    code.push_back(opcode);
+}
+
+// An instruction Run() may execute inside an idle loop, on random registers
+static uint16_t MakeIdleSafe(std::mt19937& rng) {
+    uint16_t x = rng() % 16;
+    uint16_t y = rng() % 16;
+    uint16_t kk = (rng() % 2) ? rng() % 3 : rng() % 256;
+    static const uint16_t arithmetic[] = {0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xE};
+
+    switch (rng() % 14) {
+        case 0: return 0x3000u | x << 8u | kk;
+        case 1: return 0x4000u | x << 8u | kk;
+        case 2: return ((rng() % 2) ? 0x5000u : 0x9000u) | x << 8u | y << 4u;
+        case 3: return 0x6000u | x << 8u | kk;
+        case 4: return 0x7000u | x << 8u | ((rng() % 2) ? 0 : kk);
+        case 5: case 6: return 0x8000u | x << 8u | y << 4u | arithmetic[rng() % 9];
+        case 7: return 0xA300u | (rng() % 256);
+        case 8: return 0xE000u | x << 8u | ((rng() % 2) ? 0x9Eu : 0xA1u);
+        case 9: case 10: return 0xF007u | x << 8u;
+        case 11: return 0xF01Eu | x << 8u;
+        case 12: return 0xF029u | x << 8u;
+        default: return 0xF065u | (rng() % 4) << 8u;
+    }
+}
+
+// Random registers, I and delay timer, then one loop of a random kind at 0x200 + 2 * head, then a draw and a jump back
+// to the start, so the loop is left and entered again as the timer runs out or keys change:
+//   a delay-timer poll (Fx07, 3xkk, 1nnn), the way games wait for the next tick
+//   the same poll leaking a register on every pass, or copying the timer one pass late, so it is almost idle
+//   a jump to itself
+//   a random loop of idle-safe instructions, idle or not
+static std::vector<uint8_t> MakeRom(std::mt19937& rng) {
+    std::vector<uint16_t> code;
+
+    for (uint16_t x = 0; x < 16; ++x) {
+        Append(code, 0x6000u | x << 8u | (rng() % 256));
+    }
+    Append(code, 0xA300u | (rng() % 256));
+    uint16_t timer = rng() % 15;
+    Append(code, 0x6000u | timer << 8u | (rng() % 8));
+    Append(code, 0xF015u | timer << 8u);
+
+    uint16_t head = 0x200 + 2 * code.size();
+    uint16_t x = rng() % 16;
+    uint16_t y = (x + 1 + rng() % 15) % 16;
+    switch (rng() % 6) {
+        case 0:
+            Append(code, 0xF007u | x << 8u);
+            Append(code, 0x3000u | x << 8u);
+            Append(code, 0x1000u | head);
+            break;
+        case 1:
+            Append(code, 0xF007u | x << 8u);
+            Append(code, 0x7001u | y << 8u);
+            Append(code, 0x3000u | x << 8u);
+            Append(code, 0x1000u | head);
+            break;
+        case 2:
+            Append(code, 0x8000u | y << 8u | x << 4u);
+            Append(code, 0xF007u | x << 8u);
+            Append(code, 0x3000u | y << 8u);
+            Append(code, 0x1000u | head);
+            break;
+        case 3:
+            Append(code, 0x1000u | head);
+            break;
+        default: {
+            unsigned int length = 1 + rng() % MAX_LOOP_INSTRUCTIONS;
+            for (unsigned int i = 0; i < length; ++i) {
+                Append(code, MakeIdleSafe(rng));
+            }
+            Append(code, 0x1000u | head);
+            break;
+        }
+    }
+
+    Append(code, 0xF029u | x << 8u);
+    Append(code, 0xD125u);
+    Append(code, 0xF015u | timer << 8u);
+    Append(code, 0x1000u | head);
+
+    std::vector<uint8_t> rom;
+    for (uint16_t opcode : code) {
+        rom.push_back(static_cast<uint8_t>(opcode >> 8u));
+        rom.push_back(static_cast<uint8_t>(opcode & 0xFFu));
+    }
+
+    return rom;
+}
+
+// Runs generated loops with Run(), which skips idle passes, and with Cycle() one instruction at a time, on budgets
+// that are mostly not a multiple of the loop's length, and compares the whole machine state after every frame
+int main() {
+    std::mt19937 rng(1);
+    std::vector<uint8_t> expected(Chip8::GetStateSize(Quirks::XoChip));
+    std::vector<uint8_t> actual(expected.size());
+    unsigned int failures = 0;
+    // ROMs where Run() skipped something, so the test is known to reach the idle-loop code
+    unsigned int skipping = 0;
+
+    for (unsigned int i = 0; i < ROMS; ++i)
+    {
+        std::vector<uint8_t> rom = MakeRom(rng);
+        Quirks quirks = PROFILES[i % (sizeof(PROFILES) / sizeof(PROFILES[0]))];
+
+        Chip8 reference(1 + i);
+        Chip8 chip8(1 + i);
+        for (Chip8* machine : {&reference, &chip8})
+        {
+            machine->SetQuirks(quirks);
+            machine->LoadROM(rom.data(), rom.size());
+        }
+
+        for (unsigned int frame = 0; frame < FRAMES; ++frame)
+        {
+            // key polls see keys come and go between frames, never during one
+            uint16_t keys = (rng() % 2) ? 0 : static_cast<uint16_t>(1u << (rng() % 16));
+            reference.SetKeys(keys);
+            chip8.SetKeys(keys);
+
+            unsigned int cycles = 1 + rng() % MAX_CYCLES_PER_FRAME;
+            for (unsigned int cycle = 0; cycle < cycles; ++cycle)
+            {
+                reference.Cycle();
+            }
+            reference.TickTimers();
+            chip8.RunFrame(cycles);
+
+            size_t size = reference.GetStateSize();
+            reference.SaveState(expected.data());
+            chip8.SaveState(actual.data());
+            if (memcmp(expected.data(), actual.data(), size) != 0)
+            {
+                std::cerr << "ROM " << i << " (" << GetQuirksName(quirks) << "), frame " << frame << " of " << cycles
+                          << " cycles: Run() and Cycle() disagree\n";
+                ++failures;
+                break;
+            }
+        }
+
+        if (chip8.GetInstructions() < reference.GetInstructions())
+        {
+            ++skipping;
+        }
+    }
+
+    if (skipping == 0)
+    {
+        std::cerr << "No loop was skipped\n";
+        ++failures;
+    }
+
+    std::cout << skipping << " of " << ROMS << " ROMs skipped idle passes\n";
+    std::cout << (failures ? "FAILED" : "passed") << "\n";
+
+    return failures ? EXIT_FAILURE : 0;
+}
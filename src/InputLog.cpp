@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include "InputLog.hpp"
+
+// log header: magic bytes followed by the format version
+const uint8_t LOG_MAGIC[4] = {'C', '8', 'I', 'N'};
+const uint8_t LOG_VERSION = 2;
+
+// variable-length unsigned integer, 7 bits per byte
+static void PutVarint(std::vector<uint8_t>& out, unsigned long long value) {
+    while (value >= 0x80u) {
+        out.push_back(static_cast<uint8_t>(value | 0x80u));
+        value >>= 7u;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+// returns false if the varint runs past end or is too long to be valid
+static bool GetVarint(uint8_t const*& in, uint8_t const* end, unsigned long long& value) {
+    value = 0;
+
+    for (unsigned int shift = 0; shift < 64; shift += 7) {
+        if (in == end) {
+            return false;
+        }
+        uint8_t byte = *in++;
+        value |= static_cast<unsigned long long>(byte & 0x7Fu) << shift;
+        if (!(byte & 0x80u)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+InputLog::InputLog(unsigned int seed, unsigned int cyclesPerFrame, Quirks quirks)
+    : seed(seed), cyclesPerFrame(cyclesPerFrame), quirks(quirks) {}
+
+void InputLog::Record(unsigned long long frame, uint16_t keys) {
+    // all keys start released, so only changes from that need storing
+    if (keys != this->keys) {
+        events.push_back(Event{frame, keys});
+        this->keys = keys;
+    }
+
+    frames = frame + 1;
+}
+
+uint16_t InputLog::Replay(unsigned long long frame) {
+    while (cursor < events.size() && events[cursor].frame <= frame) {
+        keys = events[cursor].keys;
+        ++cursor;
+    }
+
+    return keys;
+}
+
+bool InputLog::Save(char const* filename) const {
+    // header, then each event as the frame distance from the previous one and the new key mask
+    std::vector<uint8_t> buffer(std::begin(LOG_MAGIC), std::end(LOG_MAGIC));
+    buffer.push_back(LOG_VERSION);
+    PutVarint(buffer, seed);
+    PutVarint(buffer, cyclesPerFrame);
+    buffer.push_back(static_cast<uint8_t>(quirks));
+    PutVarint(buffer, frames);
+
+    unsigned long long previous = 0;
+    for (Event const& event : events) {
+        PutVarint(buffer, event.frame - previous);
+        buffer.push_back(event.keys & 0xFFu);
+        buffer.push_back(event.keys >> 8u);
+        previous = event.frame;
+    }
+
+    std::ofstream file(filename, std::ios::binary);
+    file.write(reinterpret_cast<char const*>(buffer.data()), buffer.size());
+
+    return file.good();
+}
+
+bool InputLog::Load(char const* filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    std::vector<uint8_t> buffer((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    uint8_t const* in = buffer.data();
+    uint8_t const* end = in + buffer.size();
+
+    if (buffer.size() < sizeof(LOG_MAGIC) + 1 || !std::equal(std::begin(LOG_MAGIC), std::end(LOG_MAGIC), in)
+        || in[sizeof(LOG_MAGIC)] != LOG_VERSION) {
+        return false;
+    }
+    in += sizeof(LOG_MAGIC) + 1;
+
+    unsigned long long newSeed, newCyclesPerFrame, newFrames;
+    if (!GetVarint(in, end, newSeed) || !GetVarint(in, end, newCyclesPerFrame)) {
+        return false;
+    }
+    if (in == end || *in >= static_cast<uint8_t>(Quirks::Count)) {
+        return false;
+    }
+    Quirks newQuirks = static_cast<Quirks>(*in++);
+    if (!GetVarint(in, end, newFrames)) {
+        return false;
+    }
+
+    std::vector<Event> newEvents;
+    unsigned long long frame = 0;
+    while (in < end) {
+        unsigned long long delta;
+        if (!GetVarint(in, end, delta) || end - in < 2) {
+            return false;
+        }
+        frame += delta;
+        newEvents.push_back(Event{frame, static_cast<uint16_t>(in[0] | (in[1] << 8u))});
+        in += 2;
+    }
+
+    // only replace the current log once the whole file has been validated
+    seed = static_cast<unsigned int>(newSeed);
+    cyclesPerFrame = static_cast<unsigned int>(newCyclesPerFrame);
+    quirks = newQuirks;
+    frames = newFrames;
+    events.swap(newEvents);
+    keys = 0;
+    cursor = 0;
+
+    return true;
+}
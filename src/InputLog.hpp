@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Chip8.hpp"
+
+// Recording of everything that makes a run non-deterministic: the RNG seed, the instruction rate, the quirk profile and
+// the keypad state at the start of every frame. Only changes are stored, so a long session is a few KB.
+// Replaying it from a fresh machine with the same ROM reproduces the original run bit for bit.
+class InputLog {
+public:
+    InputLog() = default;
+    InputLog(unsigned int seed, unsigned int cyclesPerFrame, Quirks quirks);
+
+    // Remembers the keypad mask (bit n = key n) as it is before frame runs; frames must be recorded in increasing order
+    void Record(unsigned long long frame, uint16_t keys);
+    // Returns the keypad mask recorded for frame; frames must be replayed in increasing order
+    uint16_t Replay(unsigned long long frame);
+
+    bool Save(char const* filename) const;
+    // Replaces the log with the one in filename; returns false if it is not a valid log
+    bool Load(char const* filename);
+
+    unsigned int GetSeed() const { return seed; }
+    unsigned int GetCyclesPerFrame() const { return cyclesPerFrame; }
+    Quirks GetQuirks() const { return quirks; }
+    // Number of frames the recording covers
+    unsigned long long GetFrames() const { return frames; }
+
+private:
+    // the keypad as a 16-bit mask (bit n = key n), from frame onwards
+    struct Event {
+        unsigned long long frame{};
+        uint16_t keys{};
+    };
+
+    unsigned int seed{};
+    unsigned int cyclesPerFrame{};
+    Quirks quirks = Quirks::Modern;
+    unsigned long long frames{};
+    std::vector<Event> events;
+
+    // keypad mask currently in effect while recording or replaying, and the next event to replay
+    uint16_t keys{};
+    size_t cursor{};
+};
@@ -0,0 +1,410 @@
+#include "Jit.hpp"
+
+#ifdef CHIP8_JIT_X64
+#include <sys/mman.h>
+#endif
+
+// size of the executable code cache; it is flushed wholesale when it fills up
+const size_t CODE_CACHE_SIZE = 1024 * 1024;
+// longest run of instructions translated into one block
+const unsigned int MAX_BLOCK_INSTRUCTIONS = 32;
+// upper bound on the machine code for one block, checked before translation starts
+const size_t MAX_BLOCK_BYTES = MAX_BLOCK_INSTRUCTIONS * 48 + 64;
+
+// x86-64 register numbers used in ModRM reg fields
+const uint8_t AL = 0;
+const uint8_t CL = 1;
+
+Jit::Jit(Chip8& chip8)
+    : chip8(chip8) {
+    // generated code addresses the machine state relative to the Chip8 object passed in rdi
+    base = reinterpret_cast<uint8_t*>(&chip8);
+    registersOffset = static_cast<int32_t>(reinterpret_cast<uint8_t*>(chip8.registers) - base);
+    indexOffset = static_cast<int32_t>(reinterpret_cast<uint8_t*>(&chip8.index) - base);
+    pcOffset = static_cast<int32_t>(reinterpret_cast<uint8_t*>(&chip8.pc) - base);
+    stackOffset = static_cast<int32_t>(reinterpret_cast<uint8_t*>(chip8.stack) - base);
+    spOffset = static_cast<int32_t>(reinterpret_cast<uint8_t*>(&chip8.sp) - base);
+    delayTimerOffset = static_cast<int32_t>(reinterpret_cast<uint8_t*>(&chip8.delayTimer) - base);
+    soundTimerOffset = static_cast<int32_t>(reinterpret_cast<uint8_t*>(&chip8.soundTimer) - base);
+
+#ifdef CHIP8_JIT_X64
+    // the cache is only ever writable or executable, never both
+    void* memory = mmap(nullptr, CODE_CACHE_SIZE, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory != MAP_FAILED) {
+        code = static_cast<uint8_t*>(memory);
+        codeSize = CODE_CACHE_SIZE;
+    }
+#endif
+}
+
+Jit::~Jit() {
+#ifdef CHIP8_JIT_X64
+    if (code != nullptr) {
+        munmap(code, codeSize);
+    }
+#endif
+}
+
+bool Jit::IsSupported() {
+#ifdef CHIP8_JIT_X64
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Jit::Run(unsigned long long cycles) {
+    // a new ROM, a restored snapshot or another quirk profile invalidates everything translated so far
+    if (memoryEpoch != chip8.memoryEpoch || quirks != chip8.quirks) {
+        Flush();
+        memoryEpoch = chip8.memoryEpoch;
+        quirks = chip8.quirks;
+    }
+
+    // nothing runs while an Fx0A is parked and no key is down
+    if (chip8.waitingForKey && chip8.GetKeys() == 0) {
+        return;
+    }
+
+    // translated blocks cannot record single instructions, so a traced run is left to the interpreter
+    if (chip8.trace) {
+        for (; cycles > 0 && !(chip8.waitingForKey && chip8.GetKeys() == 0); --cycles) {
+            chip8.Cycle();
+            ++interpretedInstructions;
+        }
+        return;
+    }
+
+    while (cycles > 0) {
+        Block& block = Lookup(chip8.pc);
+
+        // run the whole block natively if it fits in what is left, otherwise single-step the interpreter;
+        // a pc that has run past the end of memory is also left to the interpreter, which wraps it the same way
+        if (block.code != nullptr && block.length <= cycles && chip8.pc < MEMORY_SIZE) {
+            block.code(base);
+            nativeInstructions += block.length;
+            chip8.instructions += block.length;
+            cycles -= block.length;
+        } else {
+            Interpret();
+            ++interpretedInstructions;
+            --cycles;
+
+            // Fx0A is never translated, so only the interpreter can park
+            if (chip8.waitingForKey) {
+                return;
+            }
+        }
+    }
+}
+
+void Jit::Flush() {
+    for (Block& block : blocks) {
+        block = Block{};
+    }
+    for (uint8_t& byte : covered) {
+        byte = 0;
+    }
+    codeUsed = 0;
+}
+
+Jit::Block& Jit::Lookup(uint16_t address) {
+    address &= MEMORY_SIZE - 1;
+
+    // translate on first visit
+    Block& block = blocks[address];
+    if (!block.compiled && code != nullptr) {
+        Compile(address, block);
+    }
+
+    return block;
+}
+
+void Jit::Interpret() {
+    // stores are never translated, so every write to code memory passes through here
+    Chip8::Instruction instruction = chip8.Fetch(chip8.pc);
+    uint16_t first = chip8.index;
+    unsigned int count = 0;
+
+    if (instruction.op == Chip8::Op::OP_Fx33) {
+        count = 3;
+    } else if (instruction.op == Chip8::Op::OP_Fx55) {
+        count = instruction.x + 1u;
+    } else if (instruction.op == Chip8::Op::OP_5xy2) {
+        count = (instruction.x > instruction.y ? instruction.x - instruction.y : instruction.y - instruction.x) + 1u;
+    }
+
+    chip8.Cycle();
+
+    // self-modifying code: drop every translation if a store hit a translated instruction
+    for (unsigned int i = 0; i < count; ++i) {
+        if (covered[(first + i) & (MEMORY_SIZE - 1)]) {
+            Flush();
+            break;
+        }
+    }
+}
+
+void Jit::Compile(uint16_t address, Block& block) {
+    // start over if this block might not fit
+    if (codeSize - codeUsed < MAX_BLOCK_BYTES) {
+        Flush();
+    }
+
+    block.compiled = true;
+
+#ifdef CHIP8_JIT_X64
+    mprotect(code, codeSize, PROT_READ | PROT_WRITE);
+
+    size_t start = codeUsed;
+    uint16_t pc = address;
+    uint16_t length = 0;
+    bool ended = false;
+    // the generated code follows the profile the machine has while compiling; Run() flushes when it changes
+    QuirkFlags const& flags = QUIRK_FLAGS[static_cast<size_t>(chip8.quirks)];
+    // on XO-CHIP a skip may have to step over a four-byte F000 nnnn, which is decided at run time by the interpreter
+    bool translateSkips = !HasInstructionSet(chip8.quirks, InstructionSet::XoChip);
+
+    while (!ended && length < MAX_BLOCK_INSTRUCTIONS && pc + 1u < MEMORY_SIZE) {
+        Chip8::Instruction instruction = chip8.Decode(pc);
+        uint16_t next = pc + 2;
+        int32_t Vx = registersOffset + instruction.x;
+        int32_t Vy = registersOffset + instruction.y;
+        int32_t VF = registersOffset + 0xF;
+        bool translated = true;
+
+        switch (instruction.op) {
+            case Chip8::Op::OP_NULL:
+                break;
+
+            // mov byte [Vx], kk
+            case Chip8::Op::OP_6xkk:
+                EmitRegisterOp(0xC6, 0, Vx); Emit(instruction.kk);
+                break;
+
+            // add byte [Vx], kk
+            case Chip8::Op::OP_7xkk:
+                EmitRegisterOp(0x80, 0, Vx); Emit(instruction.kk);
+                break;
+
+            // mov al, [Vy]; mov [Vx], al
+            case Chip8::Op::OP_8xy0:
+                EmitRegisterOp(0x8A, AL, Vy); EmitRegisterOp(0x88, AL, Vx);
+                break;
+
+            // mov al, [Vy]; or/and/xor [Vx], al; and where the profile says so, mov byte [VF], 0
+            case Chip8::Op::OP_8xy1:
+            case Chip8::Op::OP_8xy2:
+            case Chip8::Op::OP_8xy3:
+                EmitRegisterOp(0x8A, AL, Vy);
+                EmitRegisterOp(instruction.op == Chip8::Op::OP_8xy1 ? 0x08 : instruction.op == Chip8::Op::OP_8xy2 ? 0x20 : 0x30, AL, Vx);
+                if (flags.logicResetsVF) {
+                    EmitRegisterOp(0xC6, 0, VF); Emit(0x00);
+                }
+                break;
+
+            // mov al, [Vx]; add al, [Vy]; setc cl; mov [VF], cl; mov [Vx], al
+            case Chip8::Op::OP_8xy4:
+                EmitRegisterOp(0x8A, AL, Vx); EmitRegisterOp(0x02, AL, Vy);
+                Emit(0x0F); Emit(0x92); Emit(0xC1);
+                EmitRegisterOp(0x88, CL, VF); EmitRegisterOp(0x88, AL, Vx);
+                break;
+
+            // VF is written before the subtraction re-reads its operands, exactly like the interpreter
+            // mov al, [Vx]; cmp al, [Vy]; seta cl; mov [VF], cl; mov al, [Vx]; sub al, [Vy]; mov [Vx], al
+            case Chip8::Op::OP_8xy5:
+                EmitRegisterOp(0x8A, AL, Vx); EmitRegisterOp(0x3A, AL, Vy);
+                Emit(0x0F); Emit(0x97); Emit(0xC1);
+                EmitRegisterOp(0x88, CL, VF);
+                EmitRegisterOp(0x8A, AL, Vx); EmitRegisterOp(0x2A, AL, Vy); EmitRegisterOp(0x88, AL, Vx);
+                break;
+
+            // in place: mov al, [Vx]; and al, 1; mov [VF], al; shr byte [Vx], 1
+            // from Vy: mov al, [Vy]; mov cl, al; shr cl, 1; mov [Vx], cl; and al, 1; mov [VF], al
+            case Chip8::Op::OP_8xy6:
+                if (flags.shiftUsesVy) {
+                    EmitRegisterOp(0x8A, AL, Vy); Emit(0x88); Emit(0xC1); Emit(0xD0); Emit(0xE9);
+                    EmitRegisterOp(0x88, CL, Vx); Emit(0x24); Emit(0x01); EmitRegisterOp(0x88, AL, VF);
+                } else {
+                    EmitRegisterOp(0x8A, AL, Vx); Emit(0x24); Emit(0x01);
+                    EmitRegisterOp(0x88, AL, VF); EmitRegisterOp(0xD0, 5, Vx);
+                }
+                break;
+
+            // mov al, [Vy]; cmp al, [Vx]; seta cl; mov [VF], cl; mov al, [Vy]; sub al, [Vx]; mov [Vx], al
+            case Chip8::Op::OP_8xy7:
+                EmitRegisterOp(0x8A, AL, Vy); EmitRegisterOp(0x3A, AL, Vx);
+                Emit(0x0F); Emit(0x97); Emit(0xC1);
+                EmitRegisterOp(0x88, CL, VF);
+                EmitRegisterOp(0x8A, AL, Vy); EmitRegisterOp(0x2A, AL, Vx); EmitRegisterOp(0x88, AL, Vx);
+                break;
+
+            // in place: mov al, [Vx]; shr al, 7; mov [VF], al; shl byte [Vx], 1
+            // from Vy: mov al, [Vy]; mov cl, al; shl cl, 1; mov [Vx], cl; shr al, 7; mov [VF], al
+            case Chip8::Op::OP_8xyE:
+                if (flags.shiftUsesVy) {
+                    EmitRegisterOp(0x8A, AL, Vy); Emit(0x88); Emit(0xC1); Emit(0xD0); Emit(0xE1);
+                    EmitRegisterOp(0x88, CL, Vx); Emit(0xC0); Emit(0xE8); Emit(0x07); EmitRegisterOp(0x88, AL, VF);
+                } else {
+                    EmitRegisterOp(0x8A, AL, Vx); Emit(0xC0); Emit(0xE8); Emit(0x07);
+                    EmitRegisterOp(0x88, AL, VF); EmitRegisterOp(0xD0, 4, Vx);
+                }
+                break;
+
+            // mov word [I], nnn
+            case Chip8::Op::OP_Annn:
+                Emit(0x66); EmitRegisterOp(0xC7, 0, indexOffset); Emit16(instruction.nnn);
+                break;
+
+            // movzx eax, byte [Vx]; add word [I], ax
+            case Chip8::Op::OP_Fx1E:
+                Emit(0x0F); EmitRegisterOp(0xB6, AL, Vx);
+                Emit(0x66); EmitRegisterOp(0x01, AL, indexOffset);
+                break;
+
+            // timers only tick between frames, so within a block they are ordinary bytes
+            // mov al, [DT]; mov [Vx], al
+            case Chip8::Op::OP_Fx07:
+                EmitRegisterOp(0x8A, AL, delayTimerOffset); EmitRegisterOp(0x88, AL, Vx);
+                break;
+
+            // mov al, [Vx]; mov [DT], al
+            case Chip8::Op::OP_Fx15:
+                EmitRegisterOp(0x8A, AL, Vx); EmitRegisterOp(0x88, AL, delayTimerOffset);
+                break;
+
+            // mov al, [Vx]; mov [ST], al
+            case Chip8::Op::OP_Fx18:
+                EmitRegisterOp(0x8A, AL, Vx); EmitRegisterOp(0x88, AL, soundTimerOffset);
+                break;
+
+            // mov word [pc], nnn
+            case Chip8::Op::OP_1nnn:
+                EmitStorePC(instruction.nnn);
+                ended = true;
+                break;
+
+            // movzx eax, byte [V0] (or [Vx] for Bxnn); add eax, nnn; mov [pc], ax
+            case Chip8::Op::OP_Bnnn:
+                Emit(0x0F); EmitRegisterOp(0xB6, AL, flags.jumpUsesVx ? Vx : registersOffset);
+                Emit(0x05); Emit32(instruction.nnn);
+                Emit(0x66); EmitRegisterOp(0x89, AL, pcOffset);
+                ended = true;
+                break;
+
+            // movzx eax, byte [sp]; mov word [stack + rax*2], next; inc byte [sp]; and byte [sp], 15; mov word [pc], nnn
+            case Chip8::Op::OP_2nnn:
+                Emit(0x0F); EmitRegisterOp(0xB6, AL, spOffset);
+                Emit(0x66); Emit(0xC7); Emit(0x84); Emit(0x47); Emit32(stackOffset); Emit16(next);
+                EmitRegisterOp(0xFE, 0, spOffset);
+                EmitRegisterOp(0x80, 4, spOffset); Emit(0x0F);
+                EmitStorePC(instruction.nnn);
+                ended = true;
+                break;
+
+            // dec byte [sp]; and byte [sp], 15; movzx eax, byte [sp]; movzx ecx, word [stack + rax*2]; mov [pc], cx
+            case Chip8::Op::OP_00EE:
+                EmitRegisterOp(0xFE, 1, spOffset);
+                EmitRegisterOp(0x80, 4, spOffset); Emit(0x0F);
+                Emit(0x0F); EmitRegisterOp(0xB6, AL, spOffset);
+                Emit(0x0F); Emit(0xB7); Emit(0x8C); Emit(0x47); Emit32(stackOffset);
+                Emit(0x66); EmitRegisterOp(0x89, CL, pcOffset);
+                ended = true;
+                break;
+
+            // cmp byte [Vx], kk; then select the next pc with cmov
+            case Chip8::Op::OP_3xkk:
+            case Chip8::Op::OP_4xkk:
+                if (!translateSkips) {
+                    translated = false;
+                    break;
+                }
+                EmitRegisterOp(0x80, 7, Vx); Emit(instruction.kk);
+                EmitSkip(instruction.op == Chip8::Op::OP_3xkk ? 0x44 : 0x45, next);
+                ended = true;
+                break;
+
+            // mov al, [Vx]; cmp al, [Vy]; then select the next pc with cmov
+            case Chip8::Op::OP_5xy0:
+            case Chip8::Op::OP_9xy0:
+                if (!translateSkips) {
+                    translated = false;
+                    break;
+                }
+                EmitRegisterOp(0x8A, AL, Vx); EmitRegisterOp(0x3A, AL, Vy);
+                EmitSkip(instruction.op == Chip8::Op::OP_5xy0 ? 0x44 : 0x45, next);
+                ended = true;
+                break;
+
+            // everything else ends the block and runs through the interpreter
+            default:
+                translated = false;
+                break;
+        }
+
+        if (!translated) {
+            break;
+        }
+
+        covered[pc] = 1;
+        covered[pc + 1] = 1;
+        ++length;
+        pc = next;
+    }
+
+    if (length == 0) {
+        // nothing translatable here; remember that, but retry if the instruction is ever overwritten
+        codeUsed = start;
+        covered[address] = 1;
+        covered[(address + 1) & (MEMORY_SIZE - 1)] = 1;
+    } else {
+        // blocks that stopped early fall through to the next address
+        if (!ended) {
+            EmitStorePC(pc);
+        }
+        // ret
+        Emit(0xC3);
+
+        block.code = reinterpret_cast<BlockFunc>(code + start);
+        block.length = length;
+    }
+
+    mprotect(code, codeSize, PROT_READ | PROT_EXEC);
+#endif
+}
+
+void Jit::Emit(uint8_t byte) {
+    code[codeUsed++] = byte;
+}
+
+void Jit::Emit16(uint16_t value) {
+    Emit(value & 0xFFu);
+    Emit(value >> 8u);
+}
+
+void Jit::Emit32(uint32_t value) {
+    Emit16(value & 0xFFFFu);
+    Emit16(value >> 16u);
+}
+
+// emits opcode followed by a ModRM addressing [rdi + offset] with the given reg field
+void Jit::EmitRegisterOp(uint8_t opcode, uint8_t reg, int32_t offset) {
+    Emit(opcode);
+    Emit(0x80u | (reg << 3u) | 0x07u);
+    Emit32(static_cast<uint32_t>(offset));
+}
+
+// mov word [pc], value
+void Jit::EmitStorePC(uint16_t value) {
+    Emit(0x66);
+    EmitRegisterOp(0xC7, 0, pcOffset);
+    Emit16(value);
+}
+
+// mov ecx, next; mov edx, next + 2; cmovcc ecx, edx; mov [pc], cx
+void Jit::EmitSkip(uint8_t cmov, uint16_t next) {
+    Emit(0xB9); Emit32(next);
+    Emit(0xBA); Emit32(static_cast<uint16_t>(next + 2));
+    Emit(0x0F); Emit(cmov); Emit(0xCA);
+    Emit(0x66); EmitRegisterOp(0x89, CL, pcOffset);
+}
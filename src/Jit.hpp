@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Chip8.hpp"
+
+// Native x86-64 code is only generated where we know how to get executable memory
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#define CHIP8_JIT_X64 1
+#endif
+
+// Dynamic recompiler: translates basic blocks of CHIP-8 code into x86-64 and runs them natively.
+// Anything it does not translate (drawing, input, RNG, memory stores...) is handed to Chip8::Cycle,
+// which also remains the reference the translated code is checked against.
+class Jit {
+public:
+    // Binds the recompiler to one machine; translations are dropped automatically when it loads a ROM or a snapshot or changes quirks
+    explicit Jit(Chip8& chip8);
+    ~Jit();
+
+    Jit(Jit const&) = delete;
+    Jit& operator=(Jit const&) = delete;
+
+    // True when native code can be generated on this host; otherwise Run() only interprets
+    static bool IsSupported();
+
+    // Runs exactly cycles instructions, natively where possible; like Chip8::Run it leaves the timers alone
+    void Run(unsigned long long cycles);
+    // Throws away every translated block
+    void Flush();
+
+    unsigned long long GetNativeInstructions() const { return nativeInstructions; }
+    unsigned long long GetInterpretedInstructions() const { return interpretedInstructions; }
+
+private:
+    typedef void (*BlockFunc)(uint8_t* base);
+
+    // Translation of the block starting at one address; length 0 means "interpret this address"
+    struct Block {
+        BlockFunc code{};
+        uint16_t length{};
+        bool compiled{};
+    };
+
+    Block& Lookup(uint16_t address);
+    void Compile(uint16_t address, Block& block);
+    void Interpret();
+
+    // Code emission helpers
+    void Emit(uint8_t byte);
+    void Emit16(uint16_t value);
+    void Emit32(uint32_t value);
+    void EmitRegisterOp(uint8_t opcode, uint8_t reg, int32_t offset);
+    void EmitStorePC(uint16_t value);
+    void EmitSkip(uint8_t cmov, uint16_t next);
+
+    Chip8& chip8;
+    uint8_t* base{};
+
+    // offsets of the machine state from base, baked into the generated code
+    int32_t registersOffset{};
+    int32_t indexOffset{};
+    int32_t pcOffset{};
+    int32_t stackOffset{};
+    int32_t spOffset{};
+    int32_t delayTimerOffset{};
+    int32_t soundTimerOffset{};
+
+    uint8_t* code{};
+    size_t codeSize{};
+    size_t codeUsed{};
+
+    Block blocks[MEMORY_SIZE]{};
+    // non-zero for every byte that belongs to a translated (or deliberately untranslated) instruction
+    uint8_t covered[MEMORY_SIZE]{};
+
+    // Chip8::memoryEpoch the current translations were made against
+    uint32_t memoryEpoch{};
+    // Chip8::quirks the current translations were made for
+    Quirks quirks = Quirks::Modern;
+
+    unsigned long long nativeInstructions{};
+    unsigned long long interpretedInstructions{};
+};
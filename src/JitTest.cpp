@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "Chip8.hpp"
+#include "Jit.hpp"
+
+const unsigned int ROMS = 500;
+const unsigned int FRAMES = 200;
+const unsigned int MAX_ROM_INSTRUCTIONS = 64;
+const unsigned int MAX_CYCLES_PER_FRAME = 64;
+const Quirks PROFILES[] = {Quirks::Vip, Quirks::Chip48, Quirks::Schip, Quirks::Modern, Quirks::XoChip};
+
+// Random code weighted towards what the recompiler translates (arithmetic, skips, jumps, calls, I and timers), with
+// enough of what it hands back to the interpreter (drawing, keys, RNG, stores into the code itself) to cross often
+static std::vector<uint8_t> MakeRom(std::mt19937& rng) {
+    unsigned int length = 8 + rng() % (MAX_ROM_INSTRUCTIONS - 7);
+    std::vector<uint8_t> rom;
+
+    for (unsigned int i = 0; i < length; ++i) {
+        uint16_t x = rng() % 16;
+        uint16_t y = rng() % 16;
+        // small constants so skips and loop counters go both ways
+        uint16_t kk = (rng() % 3 == 0) ? rng() % 4 : rng() % 256;
+        uint16_t target = 0x200 + 2 * (rng() % length);
+        uint16_t back = 0x200 + 2 * (i - std::min<unsigned int>(i, rng() % 8));
+        // somewhere in the ROM, so Fx33/Fx55 overwrite code that may have been translated
+        uint16_t data = 0x200 + rng() % (2 * length);
+        uint16_t opcode = 0;
+
+        static const uint16_t arithmetic[] = {0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xE};
+        switch (rng() % 24) {
+            case 0: case 1: opcode = 0x6000u | x << 8u | kk; break;
+            case 2: case 3: opcode = 0x7000u | x << 8u | kk; break;
+            case 4: case 5: case 6: opcode = 0x8000u | x << 8u | y << 4u | arithmetic[rng() % 9]; break;
+            case 7: opcode = 0x3000u | x << 8u | kk; break;
+            case 8: opcode = 0x4000u | x << 8u | kk; break;
+            case 9: opcode = ((rng() % 2) ? 0x5000u : 0x9000u) | x << 8u | y << 4u; break;
+            case 10: case 11: opcode = 0x1000u | back; break;
+            case 12: opcode = 0x1000u | target; break;
+            case 13: opcode = (rng() % 2) ? (0x2000u | target) : 0x00EEu; break;
+            case 14: opcode = 0xA000u | data; break;
+            case 15: opcode = 0xF01Eu | x << 8u; break;
+            case 16: opcode = 0xF000u | x << 8u | ((rng() % 2) ? 0x07u : 0x15u); break;
+            case 17: opcode = 0xF018u | x << 8u; break;
+            case 18: opcode = 0xF029u | x << 8u; break;
+            case 19: opcode = 0xB000u | target; break;
+            case 20: opcode = 0xD000u | x << 8u | y << 4u | (rng() % 6); break;
+            case 21: opcode = 0xC000u | x << 8u | kk; break;
+            case 22: opcode = 0xE000u | x << 8u | ((rng() % 2) ? 0x9Eu : 0xA1u); break;
+            default: {
+                static const uint16_t memoryOps[] = {0xF033, 0xF055, 0xF065, 0xF00A};
+                opcode = memoryOps[rng() % 4] | (rng() % 4) << 8u;
+                break;
+            }
+        }
+        rom.push_back(static_cast<uint8_t>(opcode >> 8u));
+        rom.push_back(static_cast<uint8_t>(opcode & 0xFFu));
+    }
+
+    return rom;
+}
+
+// Runs random ROMs on the recompiler and, instruction by instruction, on Chip8::Cycle, and compares the whole machine
+// state and the instructions counted after every frame
+int main() {
+    std::mt19937 rng(1);
+    std::vector<uint8_t> expected(Chip8::GetStateSize(Quirks::XoChip));
+    std::vector<uint8_t> actual(expected.size());
+    unsigned int failures = 0;
+
+    if (!Jit::IsSupported())
+    {
+        std::cout << "no native code on this host, only the interpreter fallback is checked\n";
+    }
+
+    for (unsigned int i = 0; i < ROMS; ++i)
+    {
+        std::vector<uint8_t> rom = MakeRom(rng);
+        Quirks quirks = PROFILES[i % (sizeof(PROFILES) / sizeof(PROFILES[0]))];
+        unsigned int cyclesPerFrame = 1 + rng() % MAX_CYCLES_PER_FRAME;
+
+        Chip8 reference(1 + i);
+        Chip8 chip8(1 + i);
+        for (Chip8* machine : {&reference, &chip8})
+        {
+            machine->SetQuirks(quirks);
+            machine->LoadROM(rom.data(), rom.size());
+        }
+        Jit jit(chip8);
+
+        for (unsigned int frame = 0; frame < FRAMES; ++frame)
+        {
+            // mostly one key down, sometimes none, so Fx0A parks and resumes
+            uint16_t keys = (rng() % 3 == 0) ? 0 : static_cast<uint16_t>(1u << (rng() % 16));
+            reference.SetKeys(keys);
+            chip8.SetKeys(keys);
+
+            for (unsigned int cycle = 0; cycle < cyclesPerFrame; ++cycle)
+            {
+                reference.Cycle();
+            }
+            reference.TickTimers();
+            jit.Run(cyclesPerFrame);
+            chip8.TickTimers();
+
+            size_t size = reference.GetStateSize();
+            reference.SaveState(expected.data());
+            chip8.SaveState(actual.data());
+            if (memcmp(expected.data(), actual.data(), size) != 0 || reference.GetInstructions() != chip8.GetInstructions())
+            {
+                std::cerr << "ROM " << i << " (" << GetQuirksName(quirks) << ", " << cyclesPerFrame
+                          << " cycles/frame), frame " << frame << ": the recompiler's state differs\n";
+                ++failures;
+                break;
+            }
+        }
+    }
+
+    std::cout << (failures ? "FAILED" : "passed") << "\n";
+
+    return failures ? EXIT_FAILURE : 0;
+}
@@ -1,56 +1,365 @@
+#include <atomic>
 #include <chrono>
+#include <cstring>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
+#include <thread>
+#include "Audio.hpp"
 #include "Platform.hpp"
 #include "Chip8.hpp"
+#include "InputLog.hpp"
+#include "Rewind.hpp"
+#include "TripleBuffer.hpp"
+
+// frames we are allowed to fall behind before the schedule is reset instead of caught up
+const int MAX_FRAMES_BEHIND = 5;
+// how much history rewind keeps (five minutes), and how often it stores a full snapshot
+const size_t REWIND_FRAMES = 5 * 60 * FRAMES_PER_SECOND;
+const unsigned int REWIND_KEYFRAME_INTERVAL = FRAMES_PER_SECOND;
+// longest the window thread sleeps between checks for a new frame
+const int RENDER_POLL_MS = 1;
+// how often the emulation speed shown in turbo mode is measured
+const std::chrono::milliseconds SPEED_INTERVAL(500);
+const char WINDOW_TITLE[] = "CHIP-8 Emulator";
+// samples in the audio device's buffer, about 5 ms at 48 kHz
+const unsigned int DEFAULT_AUDIO_BUFFER = 256;
+
+// One finished frame, as handed from the emulation thread to the window thread
+struct Frame {
+    uint64_t video[VIDEO_PLANES][HIRES_HEIGHT][VIDEO_ROW_WORDS]{};
+    int width{};
+    int height{};
+    // rows changed since the previous frame, which is only enough if the renderer showed that one
+    uint64_t dirtyRows{};
+    // counts up from 1, so the renderer can tell how many frames it missed
+    unsigned long long number{};
+    std::chrono::steady_clock::time_point publishTime;
+    // whether turbo was on, and emulated frames per second as a multiple of real time
+    bool turbo{};
+    double speed{};
+};
 
 int main(int argc, char** argv) {
+    // options come before the positional arguments
+    bool haveSeed = false;
+    unsigned int seed = 0;
+    char const* recordFilename = nullptr;
+    char const* replayFilename = nullptr;
+    Quirks quirks = Quirks::Modern;
+    char const* keymap = DEFAULT_KEYMAP;
+    bool turbo = false;
+    unsigned int audioBuffer = DEFAULT_AUDIO_BUFFER;
+    int arg = 1;
+    while (arg < argc && std::strncmp(argv[arg], "--", 2) == 0)
+    {
+        if (std::strcmp(argv[arg], "--turbo") == 0)
+        {
+            turbo = true;
+        }
+        else if (std::strcmp(argv[arg], "--audio-buffer") == 0 && arg + 1 < argc)
+        {
+            audioBuffer = std::stoul(argv[++arg]);
+            if (audioBuffer == 0 || audioBuffer > 0x8000u || (audioBuffer & (audioBuffer - 1)) != 0)
+            {
+                std::cerr << "Audio buffer must be a power of two from 1 to 32768 samples\n";
+                std::exit(EXIT_FAILURE);
+            }
+        }
+        else if (std::strcmp(argv[arg], "--seed") == 0 && arg + 1 < argc)
+        {
+            seed = std::stoul(argv[++arg]);
+            haveSeed = true;
+        }
+        else if (std::strcmp(argv[arg], "--record") == 0 && arg + 1 < argc)
+        {
+            recordFilename = argv[++arg];
+        }
+        else if (std::strcmp(argv[arg], "--replay") == 0 && arg + 1 < argc)
+        {
+            replayFilename = argv[++arg];
+        }
+        else if (std::strcmp(argv[arg], "--quirks") == 0 && arg + 1 < argc)
+        {
+            if (!ParseQuirks(argv[++arg], quirks))
+            {
+                std::cerr << "Unknown quirks '" << argv[arg] << "', expected vip, chip48, schip, modern or xochip\n";
+                std::exit(EXIT_FAILURE);
+            }
+        }
+        else if (std::strcmp(argv[arg], "--keymap") == 0 && arg + 1 < argc)
+        {
+            keymap = argv[++arg];
+            if (!Platform::IsValidKeymap(keymap))
+            {
+                std::cerr << "Invalid keymap '" << keymap << "', expected 16 distinct keys for 0 to F\n";
+                std::exit(EXIT_FAILURE);
+            }
+        }
+        else
+        {
+            std::cerr << "Unknown option '" << argv[arg] << "'\n";
+            std::exit(EXIT_FAILURE);
+        }
+        ++arg;
+    }
+    argv += arg - 1;
+    argc -= arg - 1;
+
     // if the user doesn't provide the correct number of arguments (4), print error and exit
     if (argc != 4)
 	{
-		std::cerr << "Usage: " << argv[0] << " <Scale> <Delay> <ROM>\n";
+		std::cerr << "Usage: " << argv[0] << " [--seed <Seed>] [--record <InputLog>] [--replay <InputLog>] [--quirks <Profile>] [--keymap <Keys>] [--turbo] [--audio-buffer <Samples>] <Scale> <CyclesPerFrame> <ROM>\n";
 		std::exit(EXIT_FAILURE);
 	}
 
     // this value determines how large the emulator window will be scaled
     int videoScale = std::stoi(argv[1]);
-    // this value controls how long the emulator waits between each emulation cycle
-	int cycleDelay = std::stoi(argv[2]);
+    // this value controls how many instructions run in each 60 Hz frame, i.e. the emulated CPU speed
+	unsigned int cyclesPerFrame = std::stoul(argv[2]);
     // Stores the path of the ROM file (third argument) as a C-style string
 	char const* romFilename = argv[3];
 
+    // a replay runs with the seed, instruction rate and quirks it was recorded with
+	InputLog replayLog;
+	if (replayFilename)
+	{
+		if (!replayLog.Load(replayFilename))
+		{
+			std::cerr << "Could not load input log '" << replayFilename << "'\n";
+			std::exit(EXIT_FAILURE);
+		}
+		seed = haveSeed ? seed : replayLog.GetSeed();
+		cyclesPerFrame = replayLog.GetCyclesPerFrame();
+		quirks = replayLog.GetQuirks();
+	}
+	else if (!haveSeed)
+	{
+		seed = static_cast<unsigned int>(std::chrono::system_clock::now().time_since_epoch().count());
+	}
+	InputLog recordLog(seed, cyclesPerFrame, quirks);
+
+    // loaded before the window opens, so a bad path exits without one
+	Chip8 chip8(seed);
+	chip8.SetQuirks(quirks);
+	if (!chip8.LoadROM(romFilename))
+	{
+		std::cerr << "Could not load ROM '" << romFilename << "'\n";
+		std::exit(EXIT_FAILURE);
+	}
+
     // creates an instance of the Platform class, initializing the SDL window and renderer.
-	Platform platform("CHIP-8 Emulator", VIDEO_WIDTH * videoScale, VIDEO_HEIGHT * videoScale, VIDEO_WIDTH, VIDEO_HEIGHT);
+    // The texture is sized for high resolution once; low resolution uses its top-left quarter
+	Platform platform(WINDOW_TITLE, VIDEO_WIDTH * videoScale, VIDEO_HEIGHT * videoScale, HIRES_WIDTH, HIRES_HEIGHT);
+	platform.SetKeymap(keymap);
+	platform.SetTurbo(turbo);
+    // opened after the window, so it is closed before the platform shuts SDL down
+	Audio audio(audioBuffer);
 
-	Chip8 chip8;
-	chip8.LoadROM(romFilename);
+	Rewind rewind(REWIND_FRAMES, REWIND_KEYFRAME_INTERVAL);
 
-    // number of bytes per row of the screen that will be updated in the SDL texture
-	int videoPitch = sizeof(chip8.video[0]) * VIDEO_WIDTH;
+    // stepping backwards would desynchronise a recording or replay from its frame numbers
+	bool rewindAllowed = !recordFilename && !replayFilename;
 
-    // records the current time, which will be used to measure time intervals between emulation cycles
-	auto lastCycleTime = std::chrono::high_resolution_clock::now();
-	bool quit = false;
+    // what the window thread hands the emulation thread; the keypad is packed as bit n = key n
+	std::atomic<bool> quit{false};
+	std::atomic<bool> rewinding{false};
+	std::atomic<bool> turboOn{turbo};
+	std::atomic<uint16_t> keyMask{0};
+    // finished frames going the other way
+	TripleBuffer<Frame> frames;
+	unsigned long long frame = 0;
 
-    // handles input processing, runs the emulation cycles, and updates the display
-	while (!quit)
-	{
-        // checks for user inputs and updates the chip8.keypad array accordingly
-		quit = platform.ProcessInput(chip8.keypad);
+	auto const refreshPeriod = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / platform.GetRefreshRate()));
 
-        // calculates the time difference between the current time and the last time the emulation cycle was run
-		auto currentTime = std::chrono::high_resolution_clock::now();
-		float dt = std::chrono::duration<float, std::chrono::milliseconds::period>(currentTime - lastCycleTime).count();
+    // runs the machine at 60 frames per second and publishes every frame, never waiting for the renderer.
+    // In turbo mode it runs frames back to back and publishes only as often as the display can show them
+	std::thread emulation([&] {
+        // the wall-clock length of one frame, and the deadline the current frame must not start before
+		auto const framePeriod = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / FRAMES_PER_SECOND));
+		auto nextFrame = std::chrono::steady_clock::now();
+		auto lastPublish = nextFrame;
+		unsigned long long published = 0;
+		// rows changed by frames that were run but not published
+		uint64_t pendingRows = 0;
+		// frames run since speedStart, for the speed multiplier
+		auto speedStart = nextFrame;
+		unsigned long long speedFrames = 0;
+		double speed = 1.0;
 
-        // If enough time has passed, the emulator runs one CPU cycle via chip8.Cycle()
-		if (dt > cycleDelay)
+		while (!quit.load(std::memory_order_relaxed))
 		{
-			lastCycleTime = currentTime;
+			bool turbo = turboOn.load(std::memory_order_relaxed);
+
+            // the keypad is latched once per frame, so a recording sees exactly what the machine saw;
+            // a replay overrides the live keypad until the log runs out, then hands control back
+			uint16_t keys = keyMask.load(std::memory_order_relaxed);
+			if (replayFilename && frame < replayLog.GetFrames())
+			{
+				keys = replayLog.Replay(frame);
+			}
+			chip8.SetKeys(keys);
+
+            // while the rewind key is held, steps back one recorded frame instead of running forward
+			if (rewindAllowed && rewinding.load(std::memory_order_relaxed))
+			{
+				rewind.Pop(chip8);
+			}
+			else
+			{
+				if (recordFilename)
+				{
+					recordLog.Record(frame, keys);
+				}
+
+                // runs a burst of cyclesPerFrame instructions, queues the sound the frame ends with, then ticks the
+                // timers once, and records the result
+				chip8.Run(cyclesPerFrame);
+				audio.QueueFrame(chip8);
+				chip8.TickTimers();
+				rewind.Push(chip8);
+				++frame;
+			}
 
-			chip8.Cycle();
+			pendingRows |= chip8.TakeDirtyRows();
+			++speedFrames;
 
-			platform.Update(chip8.video, videoPitch);
+			auto currentTime = std::chrono::steady_clock::now();
+			if (currentTime - speedStart >= SPEED_INTERVAL)
+			{
+				speed = speedFrames / (std::chrono::duration<double>(currentTime - speedStart).count() * FRAMES_PER_SECOND);
+				speedStart = currentTime;
+				speedFrames = 0;
+			}
+
+            // copies the screen out for the renderer; the number tells it how many frames it missed
+			if (!turbo || currentTime - lastPublish >= refreshPeriod)
+			{
+				Frame& back = frames.GetBack();
+				std::memcpy(back.video, chip8.video, sizeof(back.video));
+				back.width = chip8.GetVideoWidth();
+				back.height = chip8.GetVideoHeight();
+				back.dirtyRows = pendingRows;
+				back.number = ++published;
+				back.publishTime = currentTime;
+				back.turbo = turbo;
+				back.speed = speed;
+				frames.Publish();
+				pendingRows = 0;
+				lastPublish = currentTime;
+			}
+
+            // turbo never waits; leaving it resumes 60 Hz pacing from now rather than catching up
+			if (turbo)
+			{
+				nextFrame = currentTime;
+				continue;
+			}
+
+            // sleeps until the next frame is due instead of spinning on the clock
+			nextFrame += framePeriod;
+			if (currentTime < nextFrame)
+			{
+				std::this_thread::sleep_until(nextFrame);
+			}
+			else if (currentTime - nextFrame > framePeriod * MAX_FRAMES_BEHIND)
+			{
+				// too far behind (e.g. the machine was suspended): drop the missed frames rather than running them all at once
+				nextFrame = currentTime;
+			}
 		}
+	});
+
+    // this thread owns the window: it handles input and presents the newest finished frame
+	bool titleTurbo = false;
+	double titleSpeed = 0.0;
+	std::chrono::steady_clock::time_point lastPublishTime;
+	unsigned long long lastShown = 0;
+	unsigned long long shown = 0;
+	unsigned long long dropped = 0;
+	unsigned long long duplicated = 0;
+
+	while (!quit.load(std::memory_order_relaxed))
+	{
+        // checks for user inputs; key changes go straight into the mask the emulation thread reads
+		if (platform.ProcessInput(keyMask))
+		{
+			quit.store(true, std::memory_order_relaxed);
+		}
+		rewinding.store(platform.IsRewinding(), std::memory_order_relaxed);
+		turboOn.store(platform.IsTurbo(), std::memory_order_relaxed);
+
+		if (frames.Acquire())
+		{
+			Frame const& current = frames.GetFront();
+
+            // display refreshes since the last frame shown for which the emulator had no new frame repeated the old one
+			if (lastShown != 0)
+			{
+				unsigned long long refreshes = (current.publishTime - lastPublishTime + refreshPeriod / 2) / refreshPeriod;
+				unsigned long long published = current.number - lastShown;
+				duplicated += refreshes > published ? refreshes - published : 0;
+			}
+
+            // frames replaced in the buffer before we got to them were never shown, and their changed rows are unknown
+			uint64_t dirtyRows = current.dirtyRows;
+			if (current.number != lastShown + 1)
+			{
+				dropped += current.number - lastShown - 1;
+				dirtyRows = ~0ull;
+			}
+			lastShown = current.number;
+			lastPublishTime = current.publishTime;
+			++shown;
+
+            // uploads and presents only if a draw or clear touched the screen since the last frame shown
+			platform.Update(&current.video[0][0][0], current.width, current.height, dirtyRows);
+
+            // turbo shows how much faster than real time the machine runs; the speed is remeasured twice a second
+			if (current.turbo != titleTurbo || (current.turbo && current.speed != titleSpeed))
+			{
+				std::ostringstream title;
+				title << WINDOW_TITLE;
+				if (current.turbo)
+				{
+					title << " - turbo " << std::fixed << std::setprecision(1) << current.speed << "x";
+				}
+				platform.SetTitle(title.str().c_str());
+				titleTurbo = current.turbo;
+				titleSpeed = current.speed;
+			}
+		}
+		else
+		{
+			if (lastShown != 0)
+			{
+                // repaints the last frame if the window asked for it
+				Frame const& current = frames.GetFront();
+				platform.Update(&current.video[0][0][0], current.width, current.height, 0);
+			}
+			platform.WaitForEvents(RENDER_POLL_MS);
+		}
+	}
+
+	emulation.join();
+
+	std::cerr << "frames shown: " << shown << ", dropped: " << dropped << ", duplicated: " << duplicated << "\n";
+	if (audio.IsOpen())
+	{
+		std::cerr << "audio underruns: " << audio.GetUnderruns() << ", dropped samples: " << audio.GetDroppedSamples() << "\n";
+	}
+
+	if (recordFilename && !recordLog.Save(recordFilename))
+	{
+		std::cerr << "Could not write input log '" << recordFilename << "'\n";
+	}
+
+    // the same checksum the headless runner prints, to check that a replay matched its recording
+	if (recordFilename || replayFilename)
+	{
+		std::cout << "frames: " << frame << "\n";
+		std::cout << "checksum: " << std::hex << std::uppercase << std::setfill('0') << std::setw(16) << chip8.Checksum() << std::dec << "\n";
 	}
 
 	return 0;
-}
\ No newline at end of file
+}
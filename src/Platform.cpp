@@ -1,14 +1,28 @@
 #include "Platform.hpp"
+#include "Chip8.hpp"
+#include "Profiler.hpp"
+#include <algorithm>
+#include <cctype>
 #include <cstdint>
+#include <iterator>
 #include <SDL2/SDL.h>
 
-Platform::Platform(char const* title, int windowWidth, int windowHeight, int textureWidth, int textureHeight) {
-    // Initializes SDL library with video subsystem to enable graphics
-    SDL_init(SDL_INIT_VIDEO);
+// RGBA colour of a pixel by which planes are lit: none, the first, the second, both
+const uint32_t PALETTE[1u << VIDEO_PLANES] = {0x000000FFu, 0xFFFFFFFFu, 0xAAAAAAFFu, 0x555555FFu};
+// assumed when the display does not report its refresh rate
+const int DEFAULT_REFRESH_RATE = 60;
+
+Platform::Platform(char const* title, int windowWidth, int windowHeight, int textureWidth, int textureHeight)
+    : textureWidth(textureWidth), textureHeight(textureHeight) {
+    SetKeymap(DEFAULT_KEYMAP);
+
+    // Initializes SDL library with the video subsystem for graphics and the audio one for Audio
+    SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
     // Creates a window with the given title, width, and height
     window = SDL_CreateWindow(title, 0, 0, windowWidth, windowHeight, SDL_WINDOW_SHOWN);
-    // Creates a renderer to handle rendering within the window, using hardware acceleration 
-    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    // Creates a renderer to handle rendering within the window, using hardware acceleration and presenting in step
+    // with the display; the emulation runs on its own thread, so waiting for the display does not slow it down
+    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
     // Creates a texture to store pixel data for the display, in RGBA8888 format with streaming access
     texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, textureWidth, textureHeight);
 }
@@ -20,172 +34,159 @@ Platform::~Platform() {
     SDL_Quit();
 }
 
-void Platform::Update(void const* buffer, int pitch) {
-    // Updates the texture with new pixel data. Buffer contains pixel data, pitch is number of bytes per row of pixels in memory
-    SDL_UpdateTexture(texture, nullptr, buffer, pitch);
-    // Clears the current rendering target
-    SDL_RenderClear(renderer);
-    // Copies the updated texture to the current rendering target
-    SDL_RenderCopy(renderer, texture, nullptr, nullptr);
-    // Presents the current rendering target to the screen
-    SDL_RenderPresent(renderer);
-}
+void Platform::Update(uint64_t const* video, int width, int height, uint64_t dirtyRows) {
+    // a new resolution shows a different part of the texture, so the whole frame is presented again
+    if (width != videoWidth || height != videoHeight) {
+        videoWidth = width;
+        videoHeight = height;
+        needsRedraw = true;
+    }
 
-bool Platform::ProcessInput(uint8_t* keys) {
-    bool quit = false;
+    // Nothing drawn and nothing to repair: skip the upload and the present entirely
+    if (dirtyRows == 0 && !needsRedraw) {
+        return;
+    }
 
-    SDL_Event event;
+    CHIP8_PROFILE_SCOPE(Present);
 
-    // Polls for any pending events (e.g., keypresses, window close requests)
-    while (SDL_PollEvent(&event)) {
-        switch (event.type) {
-            case SDL_QUIT: {
-                quit = true;
-            } break;
+    if (dirtyRows != 0) {
+        // Only the band from the first to the last dirty row is locked and rewritten
+        int firstRow = 0;
+        while (!((dirtyRows >> firstRow) & 1u)) {
+            ++firstRow;
+        }
+        int lastRow = 63;
+        while (!((dirtyRows >> lastRow) & 1u)) {
+            --lastRow;
+        }
+        if (lastRow >= height) {
+            lastRow = height - 1;
+        }
+
+        SDL_Rect band{0, firstRow, width, lastRow - firstRow + 1};
+        void* pixels;
+        int pitch;
+
+        // Expands each packed row into RGBA pixels directly in the texture; only done when a frame is presented.
+        // The loop is branch-free (the plane bits of a pixel index the palette) so the compiler can vectorise it
+        uint64_t const* planes[VIDEO_PLANES] = {video, video + HIRES_HEIGHT * VIDEO_ROW_WORDS};
+        SDL_LockTexture(texture, &band, &pixels, &pitch);
+        for (int y = firstRow; y <= lastRow; ++y) {
+            uint32_t* row = reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(pixels) + (y - firstRow) * pitch);
+            uint64_t const* first = planes[0] + y * VIDEO_ROW_WORDS;
+            uint64_t const* second = planes[1] + y * VIDEO_ROW_WORDS;
+
+            for (int x = 0; x < width; ++x) {
+                unsigned int shift = 63 - (x & 63);
+                row[x] = PALETTE[((first[x >> 6] >> shift) & 1u) | (((second[x >> 6] >> shift) & 1u) << 1u)];
+            }
+        }
+        SDL_UnlockTexture(texture);
+    }
 
-            case SDL_KEYDOWN: {
-                switch (event.key.keysym.sym) {
-                    case SDLK_ESCAPE:
-                        quit = true;
-                        break;
+    needsRedraw = false;
 
-                    case SDLK_x:
-                        keys[0] = 1;
-                        break;
+    SDL_Rect source{0, 0, width, height};
+    // Clears the current rendering target
+    SDL_RenderClear(renderer);
+    // Copies the part of the texture in use to the current rendering target, scaled to the window
+    SDL_RenderCopy(renderer, texture, &source, nullptr);
+    // Presents the current rendering target to the screen
+    SDL_RenderPresent(renderer);
+}
 
-                    case SDLK_1:
-                        keys[1] = 1;
-                        break;
+int Platform::GetRefreshRate() const {
+    SDL_DisplayMode mode;
 
-                    case SDLK_2:
-                        keys[2] = 1;
-                        break;
+    // drivers that do not know report 0
+    if (SDL_GetWindowDisplayMode(window, &mode) != 0 || mode.refresh_rate <= 0) {
+        return DEFAULT_REFRESH_RATE;
+    }
 
-                    case SDLK_3:
-                        keys[3] = 1;
-                        break;
+    return mode.refresh_rate;
+}
 
-                    case SDLK_q:
-                        keys[4] = 1;
-                        break;
+void Platform::SetTitle(char const* title) {
+    SDL_SetWindowTitle(window, title);
+}
 
-                    case SDLK_w:
-                        keys[5] = 1;
-                        break;
+void Platform::WaitForEvents(int timeoutMs) {
+    SDL_WaitEventTimeout(nullptr, timeoutMs);
+}
 
-                    case SDLK_e:
-                        keys[6] = 1;
-                        break;
+bool Platform::IsValidKeymap(char const* keys) {
+    bool used[KEYMAP_SIZE]{};
 
-                    case SDLK_a:
-                        keys[7] = 1;
-                        break;
+    // one printable character per key, 0 to F, each used once
+    unsigned int key = 0;
+    for (; keys[key] != '\0'; ++key) {
+        unsigned char c = static_cast<unsigned char>(std::tolower(static_cast<unsigned char>(keys[key])));
+        if (key == 16 || c <= ' ' || c >= KEYMAP_SIZE || used[c]) {
+            return false;
+        }
+        used[c] = true;
+    }
 
-                    case SDLK_s:
-                        keys[8] = 1;
-                        break;
+    return key == 16;
+}
 
-                    case SDLK_d:
-                        keys[9] = 1;
-                        break;
+bool Platform::SetKeymap(char const* keys) {
+    if (!IsValidKeymap(keys)) {
+        return false;
+    }
 
-                    case SDLK_z:
-                        keys[0xA] = 1;
-                        break;
+    // SDL reports letters as lowercase keycodes whatever the shift state
+    std::fill(std::begin(keymap), std::end(keymap), -1);
+    for (unsigned int key = 0; key < 16; ++key) {
+        keymap[std::tolower(static_cast<unsigned char>(keys[key]))] = static_cast<int8_t>(key);
+    }
 
-                    case SDLK_c:
-                        keys[0xB] = 1;
-                        break;
+    return true;
+}
 
-                    case SDLK_4:
-                        keys[0xC] = 1;
-                        break;
+bool Platform::ProcessInput(std::atomic<uint16_t>& keys) {
+    bool quit = false;
 
-                    case SDLK_r:
-                        keys[0xD] = 1;
-                        break;
+    SDL_Event event;
 
-                    case SDLK_f:
-                        keys[0xE] = 1;
-                        break;
+    // Polls for any pending events (e.g., keypresses, window close requests)
+    while (SDL_PollEvent(&event)) {
+        switch (event.type) {
+            case SDL_QUIT: {
+                quit = true;
+            } break;
 
-                    case SDLK_v:
-                        keys[0xF] = 1;
-                        break;
-                }
+            case SDL_WINDOWEVENT: {
+                // exposed, resized, restored... repaint the last frame even if nothing was drawn
+                needsRedraw = true;
             } break;
 
-            case SDL_KEYUP:
-            {
-                switch (event.key.keysym.sym)
-                {
-                    case SDLK_x:
-                        keys[0] = 0;
-                        break;
-
-                    case SDLK_1:
-                        keys[1] = 0;
-                        break;
-
-                    case SDLK_2:
-                        keys[2] = 0;
-                        break;
-
-                    case SDLK_3:
-                        keys[3] = 0;
-                        break;
-
-                    case SDLK_q:
-                        keys[4] = 0;
-                        break;
-
-                    case SDLK_w:
-                        keys[5] = 0;
-                        break;
-
-                    case SDLK_e:
-                        keys[6] = 0;
-                        break;
-
-                    case SDLK_a:
-                        keys[7] = 0;
-                        break;
-
-                    case SDLK_s:
-                        keys[8] = 0;
-                        break;
-
-                    case SDLK_d:
-                        keys[9] = 0;
-                        break;
-
-                    case SDLK_z:
-                        keys[0xA] = 0;
-                        break;
-
-                    case SDLK_c:
-                        keys[0xB] = 0;
-                        break;
-
-                    case SDLK_4:
-                        keys[0xC] = 0;
-                        break;
-
-                    case SDLK_r:
-                        keys[0xD] = 0;
-                        break;
-
-                    case SDLK_f:
-                        keys[0xE] = 0;
-                        break;
-
-                    case SDLK_v:
-                        keys[0xF] = 0;
-                        break;
+            case SDL_KEYDOWN:
+            case SDL_KEYUP: {
+                bool down = event.type == SDL_KEYDOWN;
+                SDL_Keycode sym = event.key.keysym.sym;
+
+                if (sym == SDLK_ESCAPE && down) {
+                    quit = true;
+                } else if (sym == SDLK_BACKSPACE) {
+                    rewinding = down;
+                } else if (sym == SDLK_TAB) {
+                    // toggles on the press, not again on auto-repeat
+                    if (down && !event.key.repeat) {
+                        turbo = !turbo;
+                    }
+                } else if (sym >= 0 && sym < KEYMAP_SIZE && keymap[sym] != -1) {
+                    // only the mapped key's bit changes, so a reader never sees a half-updated keypad
+                    uint16_t bit = static_cast<uint16_t>(1u << keymap[sym]);
+                    if (down) {
+                        keys.fetch_or(bit, std::memory_order_relaxed);
+                    } else {
+                        keys.fetch_and(static_cast<uint16_t>(~bit), std::memory_order_relaxed);
+                    }
                 }
             } break;
         }
     }
 
     return quit;
-}
\ No newline at end of file
+}
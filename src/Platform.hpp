@@ -1,17 +1,55 @@
+#pragma once
+
+#include <atomic>
 #include <cstdint>
 #include <SDL2/SDL.h>
 
+// keys 0 to F on the left of a QWERTY keyboard, laid out like the COSMAC VIP hex keypad:
+// 1 2 3 C / 4 5 6 D / 7 8 9 E / A 0 B F on 1234 / QWER / ASDF / ZXCV
+const char DEFAULT_KEYMAP[] = "x123qweasdzc4rfv";
+
 class Platform {
 public:
 	// Constructor
     Platform(char const* title, int windowWidth, int windowHeight, int textureWidth, int textureHeight);
 	// Destructor
 	~Platform();
-	// Handles drawing the graphics by updating the texture with new pixel data then rendering it to the screen
-	void Update(void const* buffer, int pitch);
-	bool ProcessInput(uint8_t* keys);
+	// Handles drawing the graphics: expands the dirty rows of the packed bitplanes (laid out like Chip8::video) into the
+	// texture then renders its top-left width x height pixels to the screen, so a resolution switch needs no new texture.
+	// Does nothing when no row changed and the window does not need repainting
+	void Update(uint64_t const* video, int width, int height, uint64_t dirtyRows);
+	// Handles pending window events; mapped keys set or clear their bit (bit n = key n) in keys as they go down or up.
+	// Returns true when the user asked to quit
+	bool ProcessInput(std::atomic<uint16_t>& keys);
+	// Replaces the keymap with the 16 characters of keys, the keyboard keys for CHIP-8 keys 0 to F.
+	// Returns false, keeping the old keymap, if IsValidKeymap() rejects it
+	bool SetKeymap(char const* keys);
+	// True for exactly 16 distinct printable characters (letters in either case)
+	static bool IsValidKeymap(char const* keys);
+	// Returns once an event is pending or timeoutMs has passed, so an idle render loop neither spins nor lags input
+	void WaitForEvents(int timeoutMs);
+	// Refresh rate of the display the window is on, in Hz
+	int GetRefreshRate() const;
+	// True while the rewind key (Backspace) is held
+	bool IsRewinding() const { return rewinding; }
+	// Turbo mode, toggled with Tab
+	bool IsTurbo() const { return turbo; }
+	void SetTurbo(bool on) { turbo = on; }
+	void SetTitle(char const* title);
 private:
     SDL_Window* window{};
 	SDL_Renderer* renderer{};
 	SDL_Texture* texture{};
+	int textureWidth{};
+	int textureHeight{};
+	// resolution of the last frame presented; a change means the whole window has to be painted again
+	int videoWidth{};
+	int videoHeight{};
+	// set when the window system asks for a repaint (expose, resize...) even though no pixels changed
+	bool needsRedraw = true;
+	// CHIP-8 key for each keycode below KEYMAP_SIZE (SDL keycodes for printable keys are their ASCII characters), -1 if none
+	static constexpr int KEYMAP_SIZE = 128;
+	int8_t keymap[KEYMAP_SIZE]{};
+	bool rewinding = false;
+	bool turbo = false;
 };
\ No newline at end of file
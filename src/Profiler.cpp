@@ -0,0 +1,183 @@
+#ifdef CHIP8_PROFILE
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include "Profiler.hpp"
+
+// files the profile is written to when the process exits, in the working directory
+const char* const FLAT_PROFILE_FILENAME = "chip8-profile.txt";
+const char* const COLLAPSED_PROFILE_FILENAME = "chip8-profile.folded";
+// rows in the hot-address table
+const size_t HOT_ADDRESSES = 32;
+
+// printable name of every Chip8::Op, in the same order
+static char const* const OP_NAMES[] = {
+    "undecoded", "invalid",
+    "00E0", "00EE", "1nnn", "2nnn", "3xkk", "4xkk", "5xy0", "6xkk", "7xkk",
+    "8xy0", "8xy1", "8xy2", "8xy3", "8xy4", "8xy5", "8xy6", "8xy7", "8xyE",
+    "9xy0", "Annn", "Bnnn", "Cxkk", "Dxyn", "Ex9E", "ExA1",
+    "Fx07", "Fx0A", "Fx15", "Fx18", "Fx1E", "Fx29", "Fx33", "Fx55", "Fx65",
+    "00Cn", "00Dn", "00FB", "00FC", "00FD", "00FE", "00FF", "5xy2", "5xy3",
+    "F000", "Fn01", "F002", "Fx30", "Fx3A", "Fx75", "Fx85",
+    // fused sequences, never dispatched in a profiled build
+    "3xkk+1nnn", "4xkk+1nnn", "5xy0+1nnn", "9xy0+1nnn", "Annn+Dxyn", "6xkk+Fx29+Dxyn", "Fx1E+Fx55+Fx1E", "Fx1E+Fx65+Fx1E",
+};
+
+// printable name of every ProfileSection, in the same order
+static char const* const SECTION_NAMES[] = {
+    "Chip8::OP_Dxyn",
+    "Platform::Update",
+};
+
+Profiler profiler;
+
+Profiler::~Profiler() {
+    if (WriteFlat(FLAT_PROFILE_FILENAME) && WriteCollapsed(COLLAPSED_PROFILE_FILENAME)) {
+        std::cerr << "profile written to " << FLAT_PROFILE_FILENAME << " and " << COLLAPSED_PROFILE_FILENAME << "\n";
+    }
+}
+
+void Profiler::Count(Chip8::Instruction const& instruction, uint16_t pc) {
+    size_t op = static_cast<size_t>(instruction.op);
+    // XO-CHIP code above the first 4 KB is folded onto the addresses below it
+    uint16_t address = pc & (MEMORY_SIZE - 1);
+
+    ++opCounts[op];
+    ++pcCounts[address];
+    pcOps[address] = static_cast<uint8_t>(op);
+    ++contexts[current].ops[op];
+
+    // follow calls and returns so the instructions after them are charged to the right call stack
+    if (instruction.op == Chip8::Op::OP_2nnn) {
+        if (contexts[current].depth == MAX_DEPTH) {
+            ++overflow;
+            return;
+        }
+
+        for (std::pair<uint16_t, uint32_t> const& child : contexts[current].children) {
+            if (child.first == instruction.nnn) {
+                current = child.second;
+                return;
+            }
+        }
+
+        uint32_t child = static_cast<uint32_t>(contexts.size());
+        contexts.push_back(Context{});
+        contexts[child].address = instruction.nnn;
+        contexts[child].parent = current;
+        contexts[child].depth = contexts[current].depth + 1;
+        contexts[current].children.emplace_back(instruction.nnn, child);
+        current = child;
+    } else if (instruction.op == Chip8::Op::OP_00EE) {
+        if (overflow > 0) {
+            --overflow;
+        } else {
+            current = contexts[current].parent;
+        }
+    }
+}
+
+void Profiler::AddTime(ProfileSection section, std::chrono::steady_clock::duration elapsed) {
+    ++sectionCalls[static_cast<size_t>(section)];
+    sectionTimes[static_cast<size_t>(section)] += elapsed;
+}
+
+bool Profiler::WriteFlat(char const* filename) const {
+    static_assert(sizeof(OP_NAMES) / sizeof(OP_NAMES[0]) == OP_COUNT, "OP_NAMES must match Chip8::Op");
+    static_assert(sizeof(SECTION_NAMES) / sizeof(SECTION_NAMES[0]) == static_cast<size_t>(ProfileSection::Count),
+                  "SECTION_NAMES must match ProfileSection");
+
+    std::ofstream file(filename);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    uint64_t total = 0;
+    for (uint64_t count : opCounts) {
+        total += count;
+    }
+    auto share = [total](uint64_t count) { return total ? 100.0 * count / total : 0.0; };
+
+    file << "instructions: " << total << "\n" << std::fixed << std::setprecision(2);
+
+    // opcodes, most executed first
+    std::vector<size_t> ops;
+    for (size_t op = 0; op < OP_COUNT; ++op) {
+        if (opCounts[op] > 0) {
+            ops.push_back(op);
+        }
+    }
+    std::sort(ops.begin(), ops.end(), [this](size_t a, size_t b) { return opCounts[a] > opCounts[b]; });
+
+    file << "\nby opcode\n" << std::setw(14) << "count" << "  " << std::setw(7) << "share" << "  opcode\n";
+    for (size_t op : ops) {
+        file << std::setw(14) << opCounts[op] << "  " << std::setw(6) << share(opCounts[op]) << "%  " << OP_NAMES[op] << "\n";
+    }
+
+    // the hottest addresses only; a ROM rarely spends its time in more than a few loops
+    std::vector<uint16_t> addresses;
+    for (uint16_t address = 0; address < MEMORY_SIZE; ++address) {
+        if (pcCounts[address] > 0) {
+            addresses.push_back(address);
+        }
+    }
+    size_t shown = std::min(HOT_ADDRESSES, addresses.size());
+    std::partial_sort(addresses.begin(), addresses.begin() + shown, addresses.end(),
+                      [this](uint16_t a, uint16_t b) { return pcCounts[a] > pcCounts[b]; });
+
+    file << "\nhottest addresses\n" << std::setw(14) << "count" << "  " << std::setw(7) << "share" << "  address  opcode\n";
+    for (size_t i = 0; i < shown; ++i) {
+        uint16_t address = addresses[i];
+        file << std::setw(14) << pcCounts[address] << "  " << std::setw(6) << share(pcCounts[address]) << "%  "
+             << std::hex << std::uppercase << std::setfill('0') << "0x" << std::setw(3) << address
+             << std::dec << std::nouppercase << std::setfill(' ') << "    " << OP_NAMES[pcOps[address]] << "\n";
+    }
+
+    file << "\ntimed sections\n" << std::setw(14) << "calls" << "  " << std::setw(12) << "total ms"
+         << "  " << std::setw(10) << "mean us" << "  section\n";
+    for (size_t section = 0; section < static_cast<size_t>(ProfileSection::Count); ++section) {
+        double seconds = std::chrono::duration<double>(sectionTimes[section]).count();
+        uint64_t calls = sectionCalls[section];
+        file << std::setw(14) << calls << "  " << std::setw(12) << seconds * 1e3 << "  "
+             << std::setw(10) << (calls ? seconds * 1e6 / calls : 0.0) << "  " << SECTION_NAMES[section] << "\n";
+    }
+
+    return file.good();
+}
+
+bool Profiler::WriteCollapsed(char const* filename) const {
+    std::ofstream file(filename);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    for (size_t i = 0; i < contexts.size(); ++i) {
+        // the stack from the top level down to this context, e.g. "main;sub_2A4;sub_31C"
+        std::vector<uint16_t> chain;
+        for (uint32_t context = static_cast<uint32_t>(i); context != 0; context = contexts[context].parent) {
+            chain.push_back(contexts[context].address);
+        }
+
+        std::string stack = "main";
+        for (auto address = chain.rbegin(); address != chain.rend(); ++address) {
+            char frame[16];
+            std::snprintf(frame, sizeof(frame), ";sub_%03X", *address);
+            stack += frame;
+        }
+
+        // each opcode is a leaf frame so the flame graph shows what every subroutine spends its time on
+        for (size_t op = 0; op < OP_COUNT; ++op) {
+            if (contexts[i].ops[op] > 0) {
+                file << stack << ";" << OP_NAMES[op] << " " << contexts[i].ops[op] << "\n";
+            }
+        }
+    }
+
+    return file.good();
+}
+
+#endif
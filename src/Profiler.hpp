@@ -0,0 +1,88 @@
+#pragma once
+
+// Optional instrumentation of the interpreter and the frontend. Build every file with -DCHIP8_PROFILE and link
+// Profiler.cpp to enable it; without the define the hooks below expand to nothing and cost nothing.
+#ifdef CHIP8_PROFILE
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "Chip8.hpp"
+
+// Regions whose wall-clock time is measured
+enum class ProfileSection {
+    Draw,
+    Present,
+    Count
+};
+
+// Counts every interpreted instruction by opcode, by address and by emulated call stack, and times the sections
+// above. There is one profile per process, written out when the process exits; it is not thread-safe, so profile
+// one machine at a time. Blocks run natively by the recompiler are not seen, only what it hands to the interpreter.
+class Profiler {
+public:
+    ~Profiler();
+
+    // Called before each instruction executes, with the address it was fetched from
+    void Count(Chip8::Instruction const& instruction, uint16_t pc);
+    void AddTime(ProfileSection section, std::chrono::steady_clock::duration elapsed);
+
+    // Per-opcode and per-address tables plus section timings, as text
+    bool WriteFlat(char const* filename) const;
+    // One "frame;frame;opcode count" line per call stack, the input format of flamegraph.pl and speedscope
+    bool WriteCollapsed(char const* filename) const;
+
+private:
+    static constexpr size_t OP_COUNT = static_cast<size_t>(Chip8::Op::Count);
+    // the CHIP-8 stack is 16 deep; deeper (wrapped) call chains stay in the deepest context
+    static constexpr unsigned int MAX_DEPTH = 16;
+
+    // A node of the calling-context tree: one subroutine reached through one particular chain of calls
+    struct Context {
+        uint16_t address{};
+        uint32_t parent{};
+        unsigned int depth{};
+        std::vector<std::pair<uint16_t, uint32_t>> children;
+        uint64_t ops[OP_COUNT]{};
+    };
+
+    uint64_t opCounts[OP_COUNT]{};
+    uint64_t pcCounts[MEMORY_SIZE]{};
+    // the opcode most recently seen at each address, for labelling the hot-address table
+    uint8_t pcOps[MEMORY_SIZE]{};
+
+    // context 0 is the top level, entered at reset
+    std::vector<Context> contexts{Context{}};
+    uint32_t current{};
+    // calls made at MAX_DEPTH, whose returns must not leave the current context
+    unsigned int overflow{};
+
+    uint64_t sectionCalls[static_cast<size_t>(ProfileSection::Count)]{};
+    std::chrono::steady_clock::duration sectionTimes[static_cast<size_t>(ProfileSection::Count)]{};
+};
+
+extern Profiler profiler;
+
+// Adds the time until the end of the enclosing scope to a section
+class ProfileScope {
+public:
+    explicit ProfileScope(ProfileSection section)
+        : section(section), start(std::chrono::steady_clock::now()) {}
+    ~ProfileScope() { profiler.AddTime(section, std::chrono::steady_clock::now() - start); }
+
+private:
+    ProfileSection section;
+    std::chrono::steady_clock::time_point start;
+};
+
+#define CHIP8_PROFILE_INSTRUCTION(instruction, pc) profiler.Count(instruction, pc)
+#define CHIP8_PROFILE_SCOPE(section) ProfileScope profileScope(ProfileSection::section)
+
+#else
+
+#define CHIP8_PROFILE_INSTRUCTION(instruction, pc)
+#define CHIP8_PROFILE_SCOPE(section)
+
+#endif
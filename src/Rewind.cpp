@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <cstring>
+#include "Rewind.hpp"
+
+// variable-length unsigned integer, 7 bits per byte
+static void PutVarint(std::vector<uint8_t>& out, size_t value) {
+    while (value >= 0x80u) {
+        out.push_back(static_cast<uint8_t>(value | 0x80u));
+        value >>= 7u;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+static size_t GetVarint(uint8_t const*& in) {
+    size_t value = 0;
+    unsigned int shift = 0;
+
+    while (*in & 0x80u) {
+        value |= static_cast<size_t>(*in++ & 0x7Fu) << shift;
+        shift += 7;
+    }
+    value |= static_cast<size_t>(*in++) << shift;
+
+    return value;
+}
+
+// encodes current as (unchanged run, changed run, XOR bytes) triples relative to key
+static void EncodeDelta(uint8_t const* current, uint8_t const* key, size_t size, std::vector<uint8_t>& out) {
+    out.clear();
+    size_t i = 0;
+
+    while (i < size) {
+        size_t start = i;
+
+        // skip unchanged bytes eight at a time, then one at a time
+        while (i + 8 <= size && memcmp(current + i, key + i, 8) == 0) {
+            i += 8;
+        }
+        while (i < size && current[i] == key[i]) {
+            ++i;
+        }
+        size_t unchanged = i - start;
+
+        size_t literal = 0;
+        while (i + literal < size && current[i + literal] != key[i + literal]) {
+            ++literal;
+        }
+
+        PutVarint(out, unchanged);
+        PutVarint(out, literal);
+        for (size_t k = 0; k < literal; ++k) {
+            out.push_back(current[i + k] ^ key[i + k]);
+        }
+        i += literal;
+    }
+}
+
+// rebuilds the snapshot a delta was encoded from
+static void DecodeDelta(std::vector<uint8_t> const& delta, std::vector<uint8_t> const& key, std::vector<uint8_t>& out) {
+    out = key;
+
+    uint8_t const* in = delta.data();
+    uint8_t const* end = in + delta.size();
+    size_t i = 0;
+
+    while (in < end) {
+        i += GetVarint(in);
+        size_t literal = GetVarint(in);
+        for (size_t k = 0; k < literal; ++k) {
+            out[i++] ^= *in++;
+        }
+    }
+}
+
+Rewind::Rewind(size_t capacity, unsigned int keyframeInterval)
+    : entries(std::max<size_t>(1, capacity)), keyframeInterval(std::max(1u, keyframeInterval)) {}
+
+void Rewind::Push(Chip8 const& chip8) {
+    // snapshot size depends on the quirk profile (XO-CHIP carries 64 KB of memory)
+    current.resize(chip8.GetStateSize());
+    chip8.SaveState(current.data());
+
+    if (count == entries.size()) {
+        Evict();
+    }
+
+    Entry& entry = entries[(head + count) % entries.size()];
+
+    // a delta only works against a keyframe of the same size, so a profile change starts a new group
+    if (!haveKeyframe || sinceKeyframe >= keyframeInterval || entries[lastKeyframe].data.size() != current.size()) {
+        entry.data = current;
+        entry.isKeyframe = true;
+        lastKeyframe = (head + count) % entries.size();
+        haveKeyframe = true;
+        sinceKeyframe = 0;
+    } else {
+        EncodeDelta(current.data(), entries[lastKeyframe].data.data(), current.size(), entry.data);
+        entry.keyframe = lastKeyframe;
+        entry.isKeyframe = false;
+        ++sinceKeyframe;
+
+        // a slot that used to hold a keyframe should not keep a full snapshot's worth of memory for a delta
+        if (entry.data.capacity() > 4 * entry.data.size() + 256) {
+            entry.data.shrink_to_fit();
+        }
+    }
+
+    ++count;
+}
+
+bool Rewind::Pop(Chip8& chip8) {
+    if (count == 0) {
+        return false;
+    }
+
+    size_t slot = (head + count - 1) % entries.size();
+    Entry& entry = entries[slot];
+
+    if (entry.isKeyframe) {
+        chip8.LoadState(entry.data.data(), entry.data.size());
+
+        // the group before this one is complete, so the next push starts a new keyframe
+        haveKeyframe = false;
+    } else {
+        DecodeDelta(entry.data, entries[entry.keyframe].data, restored);
+        chip8.LoadState(restored.data(), restored.size());
+        --sinceKeyframe;
+    }
+
+    --count;
+    return true;
+}
+
+void Rewind::Clear() {
+    head = 0;
+    count = 0;
+    sinceKeyframe = 0;
+    haveKeyframe = false;
+}
+
+size_t Rewind::GetBytes() const {
+    size_t bytes = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        bytes += entries[(head + i) % entries.size()].data.size();
+    }
+
+    return bytes;
+}
+
+void Rewind::Evict() {
+    bool wasKeyframe = entries[head].isKeyframe;
+    size_t evicted = head;
+
+    head = (head + 1) % entries.size();
+    --count;
+
+    // deltas are useless without their keyframe, so they go with it
+    if (wasKeyframe) {
+        while (count > 0 && !entries[head].isKeyframe) {
+            head = (head + 1) % entries.size();
+            --count;
+        }
+        if (evicted == lastKeyframe) {
+            haveKeyframe = false;
+        }
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Chip8.hpp"
+
+// Ring buffer of per-frame snapshots for stepping a machine backwards in time.
+// Every keyframeInterval-th entry is a full snapshot; the others are stored as the XOR against
+// that keyframe, run-length encoded, which is usually a few dozen bytes per frame.
+class Rewind {
+public:
+    // Keeps at most capacity entries, dropping the oldest ones first
+    Rewind(size_t capacity, unsigned int keyframeInterval);
+
+    // Captures the machine's current state as the newest entry
+    void Push(Chip8 const& chip8);
+    // Restores the newest entry into chip8 and removes it; returns false when there is no history
+    bool Pop(Chip8& chip8);
+    void Clear();
+
+    size_t GetCount() const { return count; }
+    // Bytes of snapshot data currently held
+    size_t GetBytes() const;
+
+private:
+    struct Entry {
+        // full snapshot for keyframes, encoded delta otherwise
+        std::vector<uint8_t> data;
+        // slot of the keyframe a delta was encoded against
+        size_t keyframe{};
+        bool isKeyframe{};
+    };
+
+    void Evict();
+
+    std::vector<Entry> entries;
+    // slot of the oldest entry
+    size_t head{};
+    size_t count{};
+
+    unsigned int keyframeInterval{};
+    // deltas pushed since the newest keyframe; a new keyframe is due once this reaches keyframeInterval
+    unsigned int sinceKeyframe{};
+    size_t lastKeyframe{};
+    bool haveKeyframe{};
+
+    // reused for every capture and restore so steady-state operation does not allocate
+    std::vector<uint8_t> current;
+    std::vector<uint8_t> restored;
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// Lock-free queue between exactly one producer thread and one consumer thread, e.g. the emulation thread and an
+// audio callback. All memory is allocated up front, and neither Write() nor Read() ever blocks or allocates.
+template <typename T>
+class RingBuffer {
+public:
+    // Holds at least capacity elements (rounded up to a power of two)
+    explicit RingBuffer(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1u;
+        }
+        buffer.reset(new T[size]());
+        mask = size - 1;
+    }
+
+    // Producer: appends as many of the count elements as fit and returns how many that was
+    size_t Write(T const* data, size_t count) {
+        size_t head = this->head.load(std::memory_order_relaxed);
+        size_t tail = this->tail.load(std::memory_order_acquire);
+        count = std::min(count, mask + 1 - (head - tail));
+
+        for (size_t i = 0; i < count; ++i) {
+            buffer[(head + i) & mask] = data[i];
+        }
+        this->head.store(head + count, std::memory_order_release);
+
+        return count;
+    }
+
+    // Consumer: takes up to count elements from the front and returns how many there were
+    size_t Read(T* data, size_t count) {
+        size_t tail = this->tail.load(std::memory_order_relaxed);
+        size_t head = this->head.load(std::memory_order_acquire);
+        count = std::min(count, head - tail);
+
+        for (size_t i = 0; i < count; ++i) {
+            data[i] = buffer[(tail + i) & mask];
+        }
+        this->tail.store(tail + count, std::memory_order_release);
+
+        return count;
+    }
+
+    // Elements waiting; only a snapshot, the other side may be reading or writing meanwhile
+    size_t GetSize() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+    size_t GetCapacity() const { return mask + 1; }
+
+private:
+    std::unique_ptr<T[]> buffer;
+    size_t mask{};
+    // free-running positions, only ever advanced by their own side; on separate cache lines
+    alignas(64) std::atomic<size_t> head{};
+    alignas(64) std::atomic<size_t> tail{};
+};
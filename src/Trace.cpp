@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include "Trace.hpp"
+
+TraceWriter::~TraceWriter() {
+    Close();
+}
+
+bool TraceWriter::Open(char const* filename, uint16_t pc, uint16_t index, uint8_t const* registers) {
+    Close();
+
+    file.open(filename, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+    failed = false;
+    closing = false;
+
+    // every buffer is allocated here, so recording never allocates
+    storage.clear();
+    freeChunks.clear();
+    pending.clear();
+    for (size_t i = 0; i < CHUNK_COUNT; ++i) {
+        storage.emplace_back(new uint8_t[CHUNK_SIZE]);
+        freeChunks.push_back(storage.back().get());
+    }
+    chunk = freeChunks.back();
+    freeChunks.pop_back();
+    out = chunk;
+    end = chunk + CHUNK_SIZE;
+    flushedBytes = 0;
+    count = 0;
+
+    // the header holds the full starting state that the records are deltas against
+    out = std::copy(std::begin(TraceFormat::MAGIC), std::end(TraceFormat::MAGIC), out);
+    *out++ = TraceFormat::VERSION;
+    *out++ = static_cast<uint8_t>(pc >> 8u);
+    *out++ = static_cast<uint8_t>(pc);
+    *out++ = static_cast<uint8_t>(index >> 8u);
+    *out++ = static_cast<uint8_t>(index);
+    out = std::copy(registers, registers + 16, out);
+    nextPc = pc;
+    lastIndex = index;
+    std::copy(registers, registers + 16, lastRegisters);
+
+    writer = std::thread(&TraceWriter::Writer, this);
+
+    return true;
+}
+
+bool TraceWriter::Close() {
+    if (!writer.joinable()) {
+        return !failed;
+    }
+
+    // queue the partly filled buffer, then let the writer drain everything and stop
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        pending.emplace_back(chunk, out - chunk);
+        flushedBytes += out - chunk;
+        closing = true;
+    }
+    changed.notify_all();
+    writer.join();
+
+    chunk = out = end = nullptr;
+    file.close();
+
+    return !failed && !file.fail();
+}
+
+void TraceWriter::Flush() {
+    std::unique_lock<std::mutex> guard(lock);
+    pending.emplace_back(chunk, out - chunk);
+    flushedBytes += out - chunk;
+    changed.notify_all();
+
+    // only waits when the disk has fallen CHUNK_COUNT buffers behind
+    changed.wait(guard, [this] { return !freeChunks.empty(); });
+    chunk = freeChunks.back();
+    freeChunks.pop_back();
+    out = chunk;
+    end = chunk + CHUNK_SIZE;
+}
+
+void TraceWriter::Writer() {
+    std::unique_lock<std::mutex> guard(lock);
+
+    while (true) {
+        changed.wait(guard, [this] { return !pending.empty() || closing; });
+        if (pending.empty()) {
+            return;
+        }
+
+        // the file is written without holding the lock, so Record() can keep filling the next buffer
+        std::pair<uint8_t*, size_t> next = pending.front();
+        pending.erase(pending.begin());
+        guard.unlock();
+        file.write(reinterpret_cast<char const*>(next.first), static_cast<std::streamsize>(next.second));
+        guard.lock();
+
+        failed |= file.fail();
+        freeChunks.push_back(next.first);
+        changed.notify_all();
+    }
+}
+
+bool TraceReader::Open(char const* filename) {
+    file.open(filename, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    buffer.resize(BUFFER_SIZE);
+    position = 0;
+    size = 0;
+    truncated = false;
+    Refill();
+
+    uint8_t const* in = buffer.data();
+    if (size < TraceFormat::HEADER_SIZE
+        || !std::equal(std::begin(TraceFormat::MAGIC), std::end(TraceFormat::MAGIC), in)
+        || in[sizeof(TraceFormat::MAGIC)] != TraceFormat::VERSION) {
+        return false;
+    }
+    in += sizeof(TraceFormat::MAGIC) + 1;
+
+    initial = TraceRecord{};
+    initial.pc = static_cast<uint16_t>((in[0] << 8u) | in[1]);
+    initial.index = static_cast<uint16_t>((in[2] << 8u) | in[3]);
+    std::copy(in + 4, in + 20, initial.registers);
+    position = TraceFormat::HEADER_SIZE;
+
+    state = initial;
+    nextPc = initial.pc;
+
+    return true;
+}
+
+bool TraceReader::Next(TraceRecord& record) {
+    if (size - position < TraceFormat::MAX_RECORD_SIZE) {
+        Refill();
+    }
+    if (position == size) {
+        return false;
+    }
+
+    // a record is cut off if it needs more bytes than the file has left
+    uint8_t const* in = buffer.data() + position;
+    uint8_t const* limit = buffer.data() + size;
+    uint8_t flags = *in++;
+    size_t needed = 2 + ((flags & TraceFormat::FLAG_PC) ? 2 : 0) + ((flags & TraceFormat::FLAG_INDEX) ? 2 : 0)
+        + ((flags & TraceFormat::FLAG_REGISTERS) ? 2 : 0);
+    if (static_cast<size_t>(limit - in) < needed) {
+        truncated = true;
+        return false;
+    }
+
+    state.opcode = static_cast<uint16_t>((in[0] << 8u) | in[1]);
+    in += 2;
+
+    state.pc = nextPc;
+    if (flags & TraceFormat::FLAG_PC) {
+        state.pc = static_cast<uint16_t>((in[0] << 8u) | in[1]);
+        in += 2;
+    }
+    nextPc = static_cast<uint16_t>(state.pc + 2);
+
+    if (flags & TraceFormat::FLAG_INDEX) {
+        state.index = static_cast<uint16_t>((in[0] << 8u) | in[1]);
+        in += 2;
+    }
+
+    if (flags & TraceFormat::FLAG_REGISTERS) {
+        uint16_t mask = static_cast<uint16_t>((in[0] << 8u) | in[1]);
+        in += 2;
+        for (unsigned int i = 0; i < 16; ++i) {
+            if (mask & (1u << i)) {
+                if (in == limit) {
+                    truncated = true;
+                    return false;
+                }
+                state.registers[i] = *in++;
+            }
+        }
+    }
+
+    position = in - buffer.data();
+    record = state;
+
+    return true;
+}
+
+void TraceReader::Refill() {
+    std::memmove(buffer.data(), buffer.data() + position, size - position);
+    size -= position;
+    position = 0;
+
+    file.read(reinterpret_cast<char*>(buffer.data() + size), static_cast<std::streamsize>(buffer.size() - size));
+    size += static_cast<size_t>(file.gcount());
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Execution trace format: a header with the magic bytes, the version and the state before the first instruction
+// (pc, I, V0-VF), then one record per executed instruction. A record is a flags byte and the opcode, followed by
+// only what the flags say changed: the pc when it is not the previous pc + 2, I after the instruction, and a mask
+// of the registers the instruction changed with their new values. A typical record is three or four bytes.
+namespace TraceFormat {
+    const uint8_t MAGIC[4] = {'C', '8', 'T', 'R'};
+    const uint8_t VERSION = 1;
+    const size_t HEADER_SIZE = 4 + 1 + 2 + 2 + 16;
+
+    const uint8_t FLAG_PC = 1u << 0u;
+    const uint8_t FLAG_INDEX = 1u << 1u;
+    const uint8_t FLAG_REGISTERS = 1u << 2u;
+    // flags byte, opcode, pc, I, register mask and all sixteen registers
+    const size_t MAX_RECORD_SIZE = 1 + 2 + 2 + 2 + 2 + 16;
+}
+
+// Writes a trace while the machine runs. Records are encoded into a memory buffer; full buffers are written out by
+// a background thread, so the interpreter never waits for the disk unless it outruns it by several megabytes.
+class TraceWriter {
+public:
+    TraceWriter() = default;
+    ~TraceWriter();
+    TraceWriter(TraceWriter const&) = delete;
+    TraceWriter& operator=(TraceWriter const&) = delete;
+
+    // Creates the file and writes the header with the state before the first instruction; returns false on failure
+    bool Open(char const* filename, uint16_t pc, uint16_t index, uint8_t const* registers);
+    // Writes what is still buffered and closes the file; returns false if any write failed
+    bool Close();
+
+    // Appends the instruction fetched at pc, with I and the registers as it left them
+    void Record(uint16_t pc, uint16_t opcode, uint16_t index, uint8_t const* registers) {
+        if (static_cast<size_t>(end - out) < TraceFormat::MAX_RECORD_SIZE) {
+            Flush();
+        }
+
+        // work out the deltas and update the members first: every store into the buffer below goes through a byte
+        // pointer, which the compiler has to assume may alias them
+        uint16_t changed = 0;
+#if defined(__SSE2__)
+        // all sixteen registers in one compare
+        __m128i current = _mm_loadu_si128(reinterpret_cast<__m128i const*>(registers));
+        __m128i last = _mm_loadu_si128(reinterpret_cast<__m128i const*>(lastRegisters));
+        changed = static_cast<uint16_t>(~_mm_movemask_epi8(_mm_cmpeq_epi8(current, last)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lastRegisters), current);
+#else
+        for (unsigned int i = 0; i < 16; ++i) {
+            changed |= static_cast<uint16_t>((registers[i] != lastRegisters[i]) << i);
+        }
+        std::memcpy(lastRegisters, registers, sizeof(lastRegisters));
+#endif
+
+        // only jumps, calls, returns and skips leave a gap
+        bool jumped = pc != nextPc;
+        nextPc = static_cast<uint16_t>(pc + 2);
+        bool indexChanged = index != lastIndex;
+        lastIndex = index;
+
+        uint8_t* p = out + 1;
+        uint8_t flags = 0;
+        *p++ = static_cast<uint8_t>(opcode >> 8u);
+        *p++ = static_cast<uint8_t>(opcode);
+        if (jumped) {
+            flags |= TraceFormat::FLAG_PC;
+            *p++ = static_cast<uint8_t>(pc >> 8u);
+            *p++ = static_cast<uint8_t>(pc);
+        }
+        if (indexChanged) {
+            flags |= TraceFormat::FLAG_INDEX;
+            *p++ = static_cast<uint8_t>(index >> 8u);
+            *p++ = static_cast<uint8_t>(index);
+        }
+        if (changed != 0) {
+            flags |= TraceFormat::FLAG_REGISTERS;
+            *p++ = static_cast<uint8_t>(changed >> 8u);
+            *p++ = static_cast<uint8_t>(changed);
+            for (unsigned int mask = changed; mask != 0; mask &= mask - 1) {
+                *p++ = lastRegisters[LowestBit(mask)];
+            }
+        }
+        *out = flags;
+
+        out = p;
+        ++count;
+    }
+
+    // Instructions recorded so far
+    unsigned long long GetCount() const { return count; }
+    // Bytes written or buffered so far, header included
+    unsigned long long GetBytes() const { return flushedBytes + (out - chunk); }
+
+private:
+    // index of the lowest set bit of a non-zero mask
+    static unsigned int LowestBit(unsigned int mask) {
+#if defined(__GNUC__) || defined(__clang__)
+        return static_cast<unsigned int>(__builtin_ctz(mask));
+#else
+        unsigned int bit = 0;
+        while (!(mask & (1u << bit))) {
+            ++bit;
+        }
+        return bit;
+#endif
+    }
+
+    // size of one buffer, and how many may be waiting for the writer before Record() has to wait
+    static constexpr size_t CHUNK_SIZE = 1u << 20u;
+    static constexpr size_t CHUNK_COUNT = 4;
+
+    // hands the current buffer to the writer thread and takes a free one
+    void Flush();
+    void Writer();
+
+    std::ofstream file;
+    bool failed = false;
+
+    // the buffer being filled, between chunk and end
+    uint8_t* chunk{};
+    uint8_t* out{};
+    uint8_t* end{};
+    unsigned long long flushedBytes{};
+
+    // what the previous record left, for delta encoding
+    uint16_t nextPc{};
+    uint16_t lastIndex{};
+    uint8_t lastRegisters[16]{};
+    unsigned long long count{};
+
+    // buffers travel from free to pending (with their filled size) and back; guarded by lock
+    std::vector<std::unique_ptr<uint8_t[]>> storage;
+    std::vector<uint8_t*> freeChunks;
+    std::vector<std::pair<uint8_t*, size_t>> pending;
+    std::mutex lock;
+    std::condition_variable changed;
+    bool closing = false;
+    std::thread writer;
+};
+
+// One decoded record: the instruction and the machine state it left
+struct TraceRecord {
+    uint16_t pc{};
+    uint16_t opcode{};
+    uint16_t index{};
+    uint8_t registers[16]{};
+};
+
+// Reads a trace back, one record at a time, streaming the file through a fixed buffer
+class TraceReader {
+public:
+    // Opens the file and reads the header; returns false if it is not a trace
+    bool Open(char const* filename);
+    // The state before the first instruction (its opcode is 0)
+    TraceRecord const& GetInitial() const { return initial; }
+    // Decodes the next record into the running state; returns false at the end of the trace or at a cut-off record
+    bool Next(TraceRecord& record);
+    // True if Next() stopped at a cut-off record rather than at the end
+    bool IsTruncated() const { return truncated; }
+
+private:
+    static constexpr size_t BUFFER_SIZE = 1u << 16u;
+
+    // moves what is left to the front of the buffer and reads more behind it
+    void Refill();
+
+    std::ifstream file;
+    std::vector<uint8_t> buffer;
+    size_t position{};
+    size_t size{};
+
+    TraceRecord initial;
+    TraceRecord state;
+    uint16_t nextPc{};
+    bool truncated = false;
+};
@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include "Trace.hpp"
+
+// number of matching instructions shown before the first divergence
+const unsigned int CONTEXT_RECORDS = 8;
+
+static bool SameState(TraceRecord const& a, TraceRecord const& b) {
+    return a.pc == b.pc && a.opcode == b.opcode && a.index == b.index
+        && std::equal(a.registers, a.registers + 16, b.registers);
+}
+
+// prints one record on a line: its position, pc, opcode, I and V0-VF
+static void PrintRecord(char const* label, unsigned long long number, TraceRecord const& record) {
+    std::cout << label << std::setw(10) << number << std::hex << std::uppercase << std::setfill('0')
+              << "  PC=" << std::setw(3) << record.pc
+              << " " << std::setw(4) << record.opcode
+              << " I=" << std::setw(3) << record.index << " ";
+    for (unsigned int i = 0; i < 16; ++i) {
+        std::cout << " " << std::setw(2) << static_cast<unsigned int>(record.registers[i]);
+    }
+    std::cout << "\n" << std::dec << std::setfill(' ') << std::nouppercase;
+}
+
+// names the fields that differ between two records
+static void PrintDifferences(TraceRecord const& a, TraceRecord const& b) {
+    std::cout << "differs in:" << std::hex << std::uppercase << std::setfill('0');
+    if (a.pc != b.pc) {
+        std::cout << " PC";
+    }
+    if (a.opcode != b.opcode) {
+        std::cout << " opcode";
+    }
+    if (a.index != b.index) {
+        std::cout << " I";
+    }
+    for (unsigned int i = 0; i < 16; ++i) {
+        if (a.registers[i] != b.registers[i]) {
+            std::cout << " V" << i;
+        }
+    }
+    std::cout << "\n" << std::dec << std::setfill(' ') << std::nouppercase;
+}
+
+int main(int argc, char** argv) {
+    // walks two traces in lockstep and stops at the first instruction where they disagree
+    if (argc != 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " <TraceA> <TraceB>\n";
+        std::exit(EXIT_FAILURE);
+    }
+
+    TraceReader a;
+    TraceReader b;
+    if (!a.Open(argv[1]))
+    {
+        std::cerr << "Could not read trace '" << argv[1] << "'\n";
+        std::exit(EXIT_FAILURE);
+    }
+    if (!b.Open(argv[2]))
+    {
+        std::cerr << "Could not read trace '" << argv[2] << "'\n";
+        std::exit(EXIT_FAILURE);
+    }
+
+    // the two runs must also start from the same state; it is numbered 0, the first instruction 1
+    TraceRecord recordA = a.GetInitial();
+    TraceRecord recordB = b.GetInitial();
+    TraceRecord context[CONTEXT_RECORDS];
+    unsigned long long number = 0;
+
+    while (SameState(recordA, recordB))
+    {
+        context[number % CONTEXT_RECORDS] = recordA;
+        ++number;
+
+        bool moreA = a.Next(recordA);
+        bool moreB = b.Next(recordB);
+        if (!moreA || !moreB)
+        {
+            if (a.IsTruncated() || b.IsTruncated())
+            {
+                std::cerr << "warning: " << argv[a.IsTruncated() ? 1 : 2] << " ends in a cut-off record\n";
+            }
+            if (moreA == moreB)
+            {
+                std::cout << "identical (" << number - 1 << " instructions)\n";
+                return 0;
+            }
+
+            // one trace ran on after the other stopped
+            std::cout << (moreA ? argv[2] : argv[1]) << " ends after " << number - 1 << " instructions, "
+                      << (moreA ? argv[1] : argv[2]) << " goes on with:\n";
+            PrintRecord(moreA ? "A " : "B ", number, moreA ? recordA : recordB);
+            return 1;
+        }
+    }
+
+    // the last few instructions both agreed on, then the two versions of the one they did not
+    std::cout << "first divergence at instruction " << number << "\n";
+    unsigned long long first = number > CONTEXT_RECORDS ? number - CONTEXT_RECORDS : 0;
+    for (unsigned long long i = first; i < number; ++i)
+    {
+        PrintRecord("  ", i, context[i % CONTEXT_RECORDS]);
+    }
+    PrintRecord("A ", number, recordA);
+    PrintRecord("B ", number, recordB);
+    PrintDifferences(recordA, recordB);
+
+    return 1;
+}
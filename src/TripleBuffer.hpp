@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free handoff of the newest value from one producer thread to one consumer thread.
+// Each side owns one of the three slots and the third is shared: the producer publishes by swapping its slot with
+// the shared one, and the consumer picks up by doing the same when something new was published. Neither side ever
+// waits for the other; a value published twice before the consumer looked is simply replaced.
+template <typename T>
+class TripleBuffer {
+public:
+    // The slot the producer fills; only the producer thread may touch it
+    T& GetBack() { return slots[back]; }
+    // Hands the back slot to the consumer, replacing anything it has not picked up yet
+    void Publish() {
+        back = shared.exchange(static_cast<uint8_t>(back | FRESH), std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // Moves the newest published value to the front; returns false, keeping the old front, if nothing new arrived
+    bool Acquire() {
+        if (!(shared.load(std::memory_order_relaxed) & FRESH)) {
+            return false;
+        }
+        front = shared.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+    // The slot the consumer reads; only the consumer thread may touch it
+    T const& GetFront() const { return slots[front]; }
+
+private:
+    // the shared index carries a flag telling whether it was published since the consumer last took it
+    static constexpr uint8_t INDEX_MASK = 3;
+    static constexpr uint8_t FRESH = 4;
+
+    T slots[3]{};
+    // each index on its own cache line so the two threads do not invalidate each other's
+    alignas(64) uint8_t back = 0;
+    alignas(64) std::atomic<uint8_t> shared{1};
+    alignas(64) uint8_t front = 2;
+};